@@ -1,3 +1,11 @@
+#include <mutex>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+#include <deque>
+#include <algorithm>
+#include <functional>
+
 #include "acmacs-base/string-join.hh"
 #include "acmacs-base/string-split.hh"
 #include "acmacs-tal/aa-transition.hh"
@@ -22,6 +30,7 @@ void acmacs::tal::v3::reset_aa_transitions(Tree& tree)
     const auto reset_node = [](Node& node) { node.aa_transitions_.clear(); };
 
     tree::iterate_leaf_pre(tree, reset_node, reset_node);
+    tree.artifacts().invalidate(artifact_t::aa_transitions);
 
 } // acmacs::tal::v3::reset_aa_transitions
 
@@ -72,11 +81,139 @@ void acmacs::tal::v3::detail::update_common_aa_for_pos(Tree& tree, seqdb::pos0_t
 
 // ----------------------------------------------------------------------
 
+namespace
+{
+    // Calculated transitions for the last few trees are kept to skip recalculation when settings are re-applied (interactive mode)
+    // and only drawing parameters were changed. The key is a fingerprint of everything the calculation depends on.
+    struct aa_transitions_key_t
+    {
+        size_t fingerprint{0};
+        size_t number_of_nodes{0};
+
+        bool operator==(const aa_transitions_key_t&) const = default;
+    };
+
+    struct cached_aa_transitions_t
+    {
+        constexpr static const size_t no_node{std::numeric_limits<size_t>::max()};
+
+        aa_transitions_key_t key;
+        std::vector<acmacs::tal::AA_Transitions> transitions{}; // pre-order
+        std::vector<size_t> node_for_left{};                    // pre-order index of node.node_for_left_aa_transitions_ (eu_20200915 methods)
+    };
+
+    constexpr const size_t aa_transitions_cache_size{4};
+    std::atomic<bool> aa_transitions_cache_enabled{false};
+
+    inline void hash_combine(size_t& seed, size_t value) { seed ^= value + 0x9e3779b97f4a7c15UL + (seed << 6) + (seed >> 2); }
+
+    aa_transitions_key_t aa_transitions_key(const acmacs::tal::Tree& tree, const acmacs::tal::draw_tree::AATransitionsParameters& parameters)
+    {
+        using namespace acmacs::tal;
+        aa_transitions_key_t key{.fingerprint = static_cast<size_t>(parameters.method)};
+        hash_combine(key.fingerprint, std::hash<double>{}(parameters.non_common_tolerance));
+        for (const auto tolerance : parameters.non_common_tolerance_per_pos)
+            hash_combine(key.fingerprint, std::hash<double>{}(tolerance));
+        hash_combine(key.fingerprint, parameters.add_to_leaves ? 1 : 0);
+        hash_combine(key.fingerprint, parameters.show_same_left_right_for_pos.has_value() ? static_cast<size_t>(**parameters.show_same_left_right_for_pos) : 0);
+
+        const auto node_key = [&key](const Node& node) {
+            ++key.number_of_nodes;
+            hash_combine(key.fingerprint, node.subtree.size());
+            hash_combine(key.fingerprint, node.hidden ? 1 : 0);
+            hash_combine(key.fingerprint, std::hash<double>{}(node.edge_length.as_number()));
+        };
+        tree::iterate_leaf_pre(
+            tree,
+            [&key, node_key](const Node& leaf) {
+                node_key(leaf);
+                hash_combine(key.fingerprint, std::hash<std::string_view>{}(*leaf.aa_sequence));
+            },
+            node_key);
+        return key;
+    }
+
+    std::mutex& aa_transitions_cache_access()
+    {
+        static std::mutex access;
+        return access;
+    }
+
+    std::deque<cached_aa_transitions_t>& aa_transitions_cache()
+    {
+        static std::deque<cached_aa_transitions_t> cache;
+        return cache;
+    }
+
+    bool restore_aa_transitions(acmacs::tal::Tree& tree, const aa_transitions_key_t& key)
+    {
+        using namespace acmacs::tal;
+        std::unique_lock lock{aa_transitions_cache_access()};
+        const auto& cache = aa_transitions_cache();
+        const auto found = std::find_if(std::begin(cache), std::end(cache), [&key](const auto& cached) { return cached.key == key; });
+        if (found == std::end(cache))
+            return false;
+        std::vector<Node*> nodes;
+        nodes.reserve(key.number_of_nodes);
+        tree::iterate_leaf_pre(tree, [&nodes](Node& node) { nodes.push_back(&node); }, [&nodes](Node& node) { nodes.push_back(&node); });
+        for (size_t node_no = 0; node_no < nodes.size(); ++node_no) {
+            nodes[node_no]->aa_transitions_ = found->transitions[node_no];
+            const auto left = found->node_for_left[node_no];
+            nodes[node_no]->node_for_left_aa_transitions_ = left == cached_aa_transitions_t::no_node ? nullptr : nodes[left];
+        }
+        return true;
+    }
+
+    void store_aa_transitions(const acmacs::tal::Tree& tree, const aa_transitions_key_t& key)
+    {
+        using namespace acmacs::tal;
+        cached_aa_transitions_t cached{.key = key};
+        cached.transitions.reserve(key.number_of_nodes);
+        std::unordered_map<const Node*, size_t> node_index;
+        const auto store = [&cached, &node_index](const Node& node) {
+            node_index.emplace(&node, cached.transitions.size());
+            cached.transitions.push_back(node.aa_transitions_);
+        };
+        tree::iterate_leaf_pre(tree, store, store);
+        cached.node_for_left.resize(cached.transitions.size(), cached_aa_transitions_t::no_node);
+        size_t node_no{0};
+        const auto store_left = [&cached, &node_index, &node_no](const Node& node) {
+            if (node.node_for_left_aa_transitions_) {
+                if (const auto found = node_index.find(node.node_for_left_aa_transitions_); found != node_index.end())
+                    cached.node_for_left[node_no] = found->second;
+            }
+            ++node_no;
+        };
+        tree::iterate_leaf_pre(tree, store_left, store_left);
+
+        std::unique_lock lock{aa_transitions_cache_access()};
+        auto& cache = aa_transitions_cache();
+        cache.push_front(std::move(cached));
+        if (cache.size() > aa_transitions_cache_size)
+            cache.pop_back();
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
 void acmacs::tal::v3::update_aa_transitions(Tree& tree, const draw_tree::AATransitionsParameters& parameters)
 {
+    if (parameters.method == draw_tree::AATransitionsParameters::method::imported)
+        return; // use transition labels stored in tjz (generated by ae perhaps via raxml --ancestral)
+
+    const auto use_cache = aa_transitions_cache_enabled.load();
+    aa_transitions_key_t key;
+    if (use_cache) {
+        key = aa_transitions_key(tree, parameters);
+        if (restore_aa_transitions(tree, key)) {
+            AD_INFO("aa transitions: tree and parameters not changed, previous calculation reused");
+            return;
+        }
+    }
+
     switch (parameters.method) {
         case draw_tree::AATransitionsParameters::method::imported:
-            // use transition labels stored in tjz (generated by ae perhaps via raxml --ancestral)
             break;
         case draw_tree::AATransitionsParameters::method::eu_20210503:
             detail::update_aa_transitions_eu_20210503(tree, parameters);
@@ -98,9 +235,23 @@ void acmacs::tal::v3::update_aa_transitions(Tree& tree, const draw_tree::AATrans
             detail::update_aa_transitions_derek_2016(tree, parameters);
             break;
     }
+    if (use_cache)
+        store_aa_transitions(tree, key);
 
 } // acmacs::tal::v3::update_aa_transitions
 
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::enable_aa_transitions_cache(bool enable)
+{
+    aa_transitions_cache_enabled = enable;
+    if (!enable) {
+        std::unique_lock lock{aa_transitions_cache_access()};
+        aa_transitions_cache().clear();
+    }
+
+} // acmacs::tal::v3::enable_aa_transitions_cache
+
 // ======================================================================
 
 // void acmacs::tal::v3::report_common_aa(const Node& /*root*/, std::optional<seqdb::pos1_t> /*pos_to_report*/, size_t /*number_leaves_threshold*/)
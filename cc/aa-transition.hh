@@ -337,6 +337,8 @@ namespace acmacs::tal::inline v3
 
     void reset_aa_transitions(Tree& tree);
     void update_aa_transitions(Tree& tree, const draw_tree::AATransitionsParameters& parameters);
+    // keep calculated transitions of the last few trees to reuse them when settings are re-applied (interactive mode), off by default
+    void enable_aa_transitions_cache(bool enable);
     void report_aa_transitions(const Node& root, const draw_tree::AATransitionsParameters& parameters);
 
     namespace detail
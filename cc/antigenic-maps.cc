@@ -178,8 +178,8 @@ void acmacs::tal::v3::AntigenicMaps::prepare(preparation_stage_t stage)
     using namespace std::string_view_literals;
 
     if (stage == 2 && prepared_ < stage) {
-        tal().tree().match(tal().chart());
-        tal().draw().layout().prepare_element<HzSections>(stage);
+        require(artifact_t::chart_match);
+        require(artifact_t::hz_sections);
         columns_rows();
         // acmacs::log::enable("settings"sv);
         maps_settings_.apply_first({"/tal-mapi"sv, "mapi"sv, "mapi-default"sv}, acmacs::settings::v3::throw_if_nothing_applied::yes);
@@ -0,0 +1,104 @@
+#include <array>
+
+#include "acmacs-base/fmt.hh"
+#include "acmacs-tal/artifacts.hh"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    using namespace acmacs::tal;
+
+    constexpr size_t bit(artifact_t art) { return size_t{1} << static_cast<size_t>(art); }
+
+    // direct dependencies, indexed by artifact_t, sources have none
+    constexpr const std::array<size_t, number_of_artifacts> direct_dependencies{
+        0,                                                                                                   // structure
+        0,                                                                                                   // sequences
+        bit(artifact_t::structure),                                                                          // node_ids
+        bit(artifact_t::structure),                                                                          // cumulative_lengths
+        bit(artifact_t::structure) | bit(artifact_t::sequences) | bit(artifact_t::cumulative_lengths),       // aa_transitions
+        bit(artifact_t::structure) | bit(artifact_t::sequences),                                             // coloring
+        bit(artifact_t::node_ids) | bit(artifact_t::sequences),                                              // clade_sections
+        bit(artifact_t::node_ids) | bit(artifact_t::aa_transitions) | bit(artifact_t::clade_sections),       // hz_sections
+        bit(artifact_t::node_ids) | bit(artifact_t::clade_sections) | bit(artifact_t::hz_sections),          // vertical_offsets
+        bit(artifact_t::sequences),                                                                          // chart_match
+    };
+
+    // transitive closure, the graph is acyclic and artifacts depend on the ones declared before them only
+    constexpr std::array<size_t, number_of_artifacts> all_dependencies()
+    {
+        std::array<size_t, number_of_artifacts> result{direct_dependencies};
+        for (size_t art = 0; art < number_of_artifacts; ++art) {
+            for (size_t on = 0; on < art; ++on) {
+                if (result[art] & (size_t{1} << on))
+                    result[art] |= result[on];
+            }
+        }
+        return result;
+    }
+
+    constexpr const auto dependencies = all_dependencies();
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+std::string_view acmacs::tal::v3::name(artifact_t art)
+{
+    using namespace std::string_view_literals;
+    switch (art) {
+        case artifact_t::structure:
+            return "structure"sv;
+        case artifact_t::sequences:
+            return "sequences"sv;
+        case artifact_t::node_ids:
+            return "node-ids"sv;
+        case artifact_t::cumulative_lengths:
+            return "cumulative-lengths"sv;
+        case artifact_t::aa_transitions:
+            return "aa-transitions"sv;
+        case artifact_t::coloring:
+            return "coloring"sv;
+        case artifact_t::clade_sections:
+            return "clade-sections"sv;
+        case artifact_t::hz_sections:
+            return "hz-sections"sv;
+        case artifact_t::vertical_offsets:
+            return "vertical-offsets"sv;
+        case artifact_t::chart_match:
+            return "chart-match"sv;
+    }
+    return "unknown"sv;
+
+} // acmacs::tal::v3::name
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::Artifacts::invalidate(artifact_t art)
+{
+    dirty_.set(static_cast<size_t>(art));
+    for (size_t dependent = 0; dependent < number_of_artifacts; ++dependent) {
+        if (dependencies[dependent] & bit(art))
+            dirty_.set(dependent);
+    }
+
+} // acmacs::tal::v3::Artifacts::invalidate
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::tal::v3::Artifacts::report() const
+{
+    std::string result;
+    for (size_t art = 0; art < number_of_artifacts; ++art) {
+        if (dirty_.test(art) && direct_dependencies[art] != 0) {
+            if (!result.empty())
+                result.append(1, ' ');
+            result.append(name(static_cast<artifact_t>(art)));
+        }
+    }
+    return result;
+
+} // acmacs::tal::v3::Artifacts::report
+
+// ----------------------------------------------------------------------
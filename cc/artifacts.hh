@@ -0,0 +1,57 @@
+#pragma once
+
+#include <bitset>
+#include <string>
+#include <string_view>
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    // Data computed from the tree for drawing. Sources are not computed, invalidating them (when the tree is modified)
+    // invalidates everything depending on them.
+    enum class artifact_t : size_t {
+        structure,          // source: topology, hidden nodes, order of leaves
+        sequences,          // source: seq ids, aa and nuc sequences of leaves
+        node_ids,           // Tree::set_first_last_next_node_id(): node ids, prev/next leaves, number of leaves in subtree
+        cumulative_lengths, // Tree::cumulative_calculate()
+        aa_transitions,     // DrawTree stage 1
+        coloring,           // DrawTree stage 1 (coloring of the tree only, other elements have their own)
+        clade_sections,     // Tree::make_clade_sections()
+        hz_sections,        // HzSections stage 2
+        vertical_offsets,   // DrawTree stage 3, gaps are added by Clades and HzSections
+        chart_match,        // Tree::match()
+    };
+
+    constexpr const size_t number_of_artifacts{static_cast<size_t>(artifact_t::chart_match) + 1};
+
+    std::string_view name(artifact_t art);
+
+    // Dirty flags of the artifacts, all are dirty initially
+    class Artifacts
+    {
+      public:
+        bool dirty(artifact_t art) const { return dirty_.test(static_cast<size_t>(art)); }
+        void computed(artifact_t art) { dirty_.reset(static_cast<size_t>(art)); }
+        void invalidate(artifact_t art); // and all artifacts depending on it
+        void invalidate_all() { dirty_.set(); }
+
+        // calls compute and marks art as computed if it is dirty, returns if compute was called
+        template <typename Compute> bool ensure(artifact_t art, Compute compute)
+        {
+            if (!dirty(art))
+                return false;
+            compute();
+            computed(art);
+            return true;
+        }
+
+        std::string report() const; // names of dirty artifacts, sources (never computed) are not listed
+
+      private:
+        std::bitset<number_of_artifacts> dirty_{std::bitset<number_of_artifacts>{}.set()};
+    };
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
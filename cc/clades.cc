@@ -41,6 +41,17 @@ void acmacs::tal::v3::Clades::prepare(preparation_stage_t stage)
 
 // ----------------------------------------------------------------------
 
+bool acmacs::tal::v3::Clades::concurrent_prepare(preparation_stage_t /*stage*/)
+{
+    if (prepared_)
+        return false;
+    require(artifact_t::clade_sections); // make_sections() then reads tree clades only
+    return true;
+
+} // acmacs::tal::v3::Clades::concurrent_prepare
+
+// ----------------------------------------------------------------------
+
 const acmacs::tal::v3::Clades::CladeParameters& acmacs::tal::v3::Clades::parameters_for_clade(std::string_view name) const
 {
     if (auto found = std::find_if(std::begin(parameters_.per_clade), std::end(parameters_.per_clade), [name](const auto& for_clade) { return for_clade.name == name; }); found != std::end(parameters_.per_clade))
@@ -57,18 +68,20 @@ void acmacs::tal::v3::Clades::make_clades()
     AD_LOG(acmacs::log::clades, "make_clades");
     make_sections();
     set_slots();
-    add_gaps_to_tree();
-    add_separators_to_time_series();
-    report_clades();
-
-    if (auto hz_sections = tal().draw().layout().find<HzSections>(); hz_sections) {
-        for (const auto& clade : clades_) {
-            for (auto [section_no, clade_section] : acmacs::enumerate(clade.sections)) {
-                hz_sections->add_section(HzSection{hz_section_id_t{fmt::format("{}-{}", clade.name, section_no)}, clade_section.first, clade_section.last,
-                                                             clade_section.display_name});
+    commit([this]() {
+        add_gaps_to_tree();
+        add_separators_to_time_series();
+        report_clades();
+
+        if (auto hz_sections = tal().draw().layout().find<HzSections>(); hz_sections) {
+            for (const auto& clade : clades_) {
+                for (auto [section_no, clade_section] : acmacs::enumerate(clade.sections)) {
+                    hz_sections->add_section(HzSection{hz_section_id_t{fmt::format("{}-{}", clade.name, section_no)}, clade_section.first, clade_section.last,
+                                                                 clade_section.display_name});
+                }
             }
         }
-    }
+    });
 
 } // acmacs::tal::v3::Clades::make_clades
 
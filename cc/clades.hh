@@ -13,6 +13,7 @@ namespace acmacs::tal::inline v3
         Clades(Tal& tal) : LayoutElement(tal, 0.0) {}
 
         void prepare(preparation_stage_t stage) override;
+        bool concurrent_prepare(preparation_stage_t stage) override;
         void draw(acmacs::surface::Surface& surface) const override;
 
         // ----------------------------------------------------------------------
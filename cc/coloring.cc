@@ -3,6 +3,7 @@
 #include "acmacs-draw/surface.hh"
 #include "acmacs-tal/coloring.hh"
 #include "acmacs-tal/tree.hh"
+#include "acmacs-tal/leaf-attributes.hh"
 
 // ----------------------------------------------------------------------
 
@@ -22,17 +23,39 @@ std::string acmacs::tal::v3::ColoringUniform::report() const
 
 // ----------------------------------------------------------------------
 
+void acmacs::tal::v3::ColoringByContinent::leaf_attributes(std::shared_ptr<const LeafAttributes> attributes)
+{
+    color_by_continent_id_.clear();
+    for (LeafAttributes::id_t id = 0; id < attributes->continents().size(); ++id)
+        color_by_continent_id_.push_back(color_of(attributes->continents()[id]));
+    attributes_ = std::move(attributes);
+
+} // acmacs::tal::v3::ColoringByContinent::leaf_attributes
+
+// ----------------------------------------------------------------------
+
 Color acmacs::tal::v3::ColoringByContinent::color(const Node& node) const
+{
+    if (attributes_ && node.is_leaf())
+        return color_by_continent_id_[attributes_->continent(node)];
+    else
+        return color_of(node.continent);
+
+} // acmacs::tal::v3::ColoringByContinent::color
+
+// ----------------------------------------------------------------------
+
+Color acmacs::tal::v3::ColoringByContinent::color_of(std::string_view continent) const
 {
     using namespace std::string_view_literals;
-    if (auto found = colors_.find(node.continent); found != colors_.end())
+    if (auto found = colors_.find(continent); found != colors_.end())
         return found->second;
     else if (auto found_unknown = colors_.find("UNKNOWN"sv); found_unknown != colors_.end())
         return found_unknown->second;
     else
         return PINK;
 
-} // acmacs::tal::v3::ColoringByContinent::color
+} // acmacs::tal::v3::ColoringByContinent::color_of
 
 // ----------------------------------------------------------------------
 
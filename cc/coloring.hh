@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+
 #include "acmacs-base/color-continent.hh"
 #include "acmacs-base/flat-map.hh"
 #include "seqdb-3/sequence.hh"
@@ -14,6 +16,7 @@ namespace acmacs::surface
 namespace acmacs::tal::inline v3
 {
     class Node;
+    class LeafAttributes;
 
     class coloring_error : public std::runtime_error
     {
@@ -33,6 +36,7 @@ namespace acmacs::tal::inline v3
 
         virtual ~Coloring() = default;
 
+        virtual void leaf_attributes(std::shared_ptr<const LeafAttributes> /*attributes*/) {} // to be called before prepare(Node)
         virtual void prepare(const Node& /*node*/) {}
         virtual void prepare() {} // to be called after coloring prepare(Node) for each node
         virtual Color color(const Node& node) const = 0;
@@ -67,14 +71,19 @@ namespace acmacs::tal::inline v3
     {
       public:
         ColoringByContinent() : colors_{continent_colors()} {}
+        void leaf_attributes(std::shared_ptr<const LeafAttributes> attributes) override;
         Color color(const Node& node) const override;
         std::string report() const override;
         std::string_view legend_type() const override { return "world-map"; }
 
-        void set(std::string_view continent, Color color) { colors_.emplace_or_replace(continent, color); }
+        void set(std::string_view continent, Color color) { colors_.emplace_or_replace(continent, color); attributes_.reset(); }
 
       private:
         continent_colors_t colors_;
+        std::shared_ptr<const LeafAttributes> attributes_;
+        std::vector<Color> color_by_continent_id_; // for leaves of attributes_
+
+        Color color_of(std::string_view continent) const;
     };
 
     // ----------------------------------------------------------------------
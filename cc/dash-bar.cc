@@ -95,29 +95,38 @@ void acmacs::tal::v3::DashBar::draw(acmacs::surface::Surface& surface) const
 
 // ======================================================================
 
+void acmacs::tal::v3::DashBarClades::prepare(preparation_stage_t stage)
+{
+    if (stage == 1 && prepared_ < stage)
+        require(artifact_t::clade_sections);
+    DashBarBase::prepare(stage);
+
+} // acmacs::tal::v3::DashBarClades::prepare
+
+// ----------------------------------------------------------------------
+
 void acmacs::tal::v3::DashBarClades::draw(acmacs::surface::Surface& surface) const
 {
     const auto* draw_tree = tal().draw().layout().find_draw_tree();
     const auto& viewport = surface.viewport();
     const auto dash_width = parameters().dash.width;
     const auto dash_pos_x = viewport.left() + viewport.size.width * (1.0 - dash_width) * 0.5;
+    const auto& tree = tal().tree();
 
     for (const auto& clade : parameters().clades) {
         double first_line_pos_y{1e20}, last_line_pos_y{-1.0}, sum_line_pos_y{0.0};
         size_t num_lines{0};
-        tree::iterate_leaf(tal().tree(), [&surface, &clade, &first_line_pos_y, &last_line_pos_y, &sum_line_pos_y, &num_lines, dash_pos_x, dash_width, viewport_width = viewport.size.width,
-                                          vertical_step = draw_tree->vertical_step(), dash_line_width = parameters().dash.line_width](const Node& leaf) {
-            if (!leaf.hidden) {
-                if (leaf.clades.exists(clade.name)) {
-                    const double vpos = vertical_step * leaf.cumulative_vertical_offset_;
-                    first_line_pos_y = std::min(first_line_pos_y, vpos);
-                    last_line_pos_y = std::max(last_line_pos_y, vpos);
-                    sum_line_pos_y += vpos;
-                    ++num_lines;
-                    surface.line({dash_pos_x, vpos}, {dash_pos_x + viewport_width * dash_width, vpos}, clade.color, dash_line_width, surface::LineCap::Round);
-                }
-            }
-        });
+        const auto& tree_clades = tree.clades();
+        if (const auto tree_clade = std::find_if(std::begin(tree_clades), std::end(tree_clades), [&clade](const auto& tc) { return tc.name == clade.name; }); tree_clade != std::end(tree_clades)) {
+            tree_clade->leaves.for_each([&](size_t vertical) {
+                const double vpos = draw_tree->vertical_step() * tree.shown_leaves()[vertical]->cumulative_vertical_offset_;
+                first_line_pos_y = std::min(first_line_pos_y, vpos);
+                last_line_pos_y = std::max(last_line_pos_y, vpos);
+                sum_line_pos_y += vpos;
+                ++num_lines;
+                surface.line({dash_pos_x, vpos}, {dash_pos_x + viewport.size.width * dash_width, vpos}, clade.color, parameters().dash.line_width, surface::LineCap::Round);
+            });
+        }
         if (!clade.label.text.empty()) {
             const Scaled label_size{viewport.size.height * clade.label.scale};
             const auto text_size = surface.text_size(clade.label.text, label_size, clade.label.text_style);
@@ -65,7 +65,7 @@ namespace acmacs::tal::inline v3
       public:
         DashBarClades(Tal& tal) : DashBarBase(tal) {}
 
-        // void prepare(preparation_stage_t stage) override;
+        void prepare(preparation_stage_t stage) override;
         void draw(acmacs::surface::Surface& surface) const override;
 
         // ----------------------------------------------------------------------
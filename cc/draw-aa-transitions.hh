@@ -17,6 +17,7 @@ namespace acmacs::tal::inline v3
         Position position() const override { return Position::absolute; }
 
         void prepare(preparation_stage_t stage) override;
+        bool concurrent_prepare(preparation_stage_t /*stage*/) override { return !prepared_; } // reads tree only
         void draw(acmacs::surface::Surface& surface) const override;
 
         void draw_transitions(acmacs::surface::Surface& surface, const DrawTree& draw_tree) const;
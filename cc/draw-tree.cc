@@ -28,18 +28,22 @@ void acmacs::tal::v3::DrawTree::prepare(preparation_stage_t stage)
     if (stage == 1 && prepared_ < stage) {
         // AD_DEBUG("DrawTree::prepare");
         tree.set_first_last_next_node_id();
-        if (parameters().aa_transitions.calculate) {
-            if (parameters().aa_transitions.use_nuc)
-                tree.replace_aa_sequence_with_nuc(); // hack to make nuc transitions
-            update_aa_transitions(tree, parameters().aa_transitions);
-        }
+        tree.artifacts().ensure(artifact_t::aa_transitions, [this, &tree]() {
+            if (parameters().aa_transitions.calculate) {
+                if (parameters().aa_transitions.use_nuc)
+                    tree.replace_aa_sequence_with_nuc(); // hack to make nuc transitions
+                update_aa_transitions(tree, parameters().aa_transitions);
+            }
+        });
 
+        coloring().leaf_attributes(tree.leaf_attributes());
         tree::iterate_leaf(tree, [this](const Node& leaf) {
             if (!leaf.hidden)
                 coloring().prepare(leaf);
         });
         coloring().prepare();
         AD_LOG(acmacs::log::coloring, "tree {}", coloring().report());
+        tree.artifacts().computed(artifact_t::coloring);
 
         if (parameters().aa_transitions.report)
             report_aa_transitions(tree, parameters().aa_transitions);
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <deque>
+
+#include "acmacs-base/filesystem.hh"
+#include "acmacs-base/timeit.hh"
+#include "acmacs-tal/log.hh"
+#include "acmacs-tal/export-pipeline.hh"
+#include "acmacs-tal/output-sink.hh"
+#include "acmacs-tal/newick.hh"
+#include "acmacs-tal/json-export.hh"
+#include "acmacs-tal/html-export.hh"
+#include "acmacs-tal/tree.hh"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    // writer does not receive events for nodes inside skipped subtree
+    struct writer_state_t
+    {
+        acmacs::tal::v3::ExportWriter* writer;
+        const acmacs::tal::v3::Node* skipped{nullptr};
+    };
+
+    void traverse(const acmacs::tal::v3::Node& node, bool last, std::vector<writer_state_t>& writers)
+    {
+        for (auto& state : writers) {
+            if (!state.skipped && !state.writer->enter(node, last))
+                state.skipped = &node;
+        }
+        for (auto sub_node = std::begin(node.subtree); sub_node != std::end(node.subtree); ++sub_node)
+            traverse(*sub_node, std::next(sub_node) == std::end(node.subtree), writers);
+        for (auto& state : writers) {
+            if (!state.skipped)
+                state.writer->leave(node, last);
+            else if (state.skipped == &node)
+                state.skipped = nullptr;
+        }
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::export_traverse(const Tree& tree, const std::vector<ExportWriter*>& writers)
+{
+    for (auto* writer : writers)
+        writer->begin(tree);
+    export_traverse_subtree(tree, writers);
+    for (auto* writer : writers)
+        writer->end(tree);
+
+} // acmacs::tal::v3::export_traverse
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::export_traverse_subtree(const Node& root, const std::vector<ExportWriter*>& writers)
+{
+    std::vector<writer_state_t> states(writers.size());
+    std::transform(std::begin(writers), std::end(writers), std::begin(states), [](auto* writer) { return writer_state_t{writer}; });
+    traverse(root, false, states);
+
+} // acmacs::tal::v3::export_traverse_subtree
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::export_trees(const std::vector<std::string_view>& filenames, const Tree& tree, const ExportOptions& options)
+{
+    // writer and sink errors (cannot open file, newick export failure, etc.) are reported as ExportError
+    try {
+        std::vector<std::unique_ptr<OutputSink>> outputs;
+        std::vector<std::unique_ptr<ExportWriter>> writers;
+        std::deque<std::string> stdout_data; // /json and /names are collected and written to stdout one after another after traversal
+
+        for (const auto filename : filenames) {
+            const fs::path filepath{filename};
+            auto ext = filepath.extension();
+            if (ext == ".bz2" || (ext == ".html" && options.html_chunk_leaves > 0)) {
+                export_tree(filename, tree, options);
+                continue;
+            }
+            if (ext == ".xz")
+                ext = filepath.stem().extension();
+            const auto make_output = [&outputs, &options, &stdout_data](std::string_view output_filename) -> OutputSink& {
+                if (output_filename == "-")
+                    return *outputs.emplace_back(std::make_unique<StringSink>(stdout_data.emplace_back()));
+                const auto compress = output_filename.back() == 'z' ? compress_output::xz : compress_output::no;
+                return *outputs.emplace_back(std::make_unique<ThreadedSink>(make_output_sink(output_filename, compress, options.compression_threads)));
+            };
+            if (ext == ".newick")
+                writers.push_back(newick_export_writer(make_output(filename), options));
+            else if (filename == "/json" || ext == ".json" || ext == ".tjz")
+                writers.push_back(json_export_writer(make_output(filename == "/json" ? std::string_view{"-"} : filename)));
+            else if (ext == ".html")
+                writers.push_back(html_export_writer(make_output(filename)));
+            else if (ext == ".txt" || ext == ".text")
+                writers.push_back(text_export_writer(make_output(filename)));
+            else if (filename == "/names" || ext == ".names")
+                writers.push_back(names_export_writer(make_output(filename == "/names" ? std::string_view{"-"} : filename)));
+            else
+                throw ExportError{fmt::format("cannot infer export method from filename: {}", filename)};
+        }
+
+        if (!writers.empty()) {
+            const Timeit ti{"exporting tree"};
+            std::vector<ExportWriter*> writer_ptrs(writers.size());
+            std::transform(std::begin(writers), std::end(writers), std::begin(writer_ptrs), [](auto& writer) { return writer.get(); });
+            export_traverse(tree, writer_ptrs);
+            for (auto& output : outputs)
+                output->close();
+        }
+        if (!stdout_data.empty()) {
+            FileSink output{"-"};
+            for (const auto& data : stdout_data)
+                output.write(data);
+            output.close();
+        }
+    }
+    catch (ExportError&) {
+        throw;
+    }
+    catch (std::exception& err) {
+        throw ExportError{fmt::format("cannot export tree: {}", err)};
+    }
+
+} // acmacs::tal::v3::export_trees
+
+// ----------------------------------------------------------------------
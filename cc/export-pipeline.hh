@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <memory>
+
+#include "acmacs-tal/import-export.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    class Tree;
+    class Node;
+
+    // Receives node events of a single pre/post traversal of the tree
+    class ExportWriter
+    {
+      public:
+        virtual ~ExportWriter() = default;
+
+        virtual void begin(const Tree& /*tree*/) {}
+        virtual void end(const Tree& /*tree*/) {}
+        // last: node is the last one in the parent subtree (false for the root)
+        // returns false if subtree of the node is not needed, neither events for its children nor leave() for the node are passed then
+        virtual bool enter(const Node& node, bool last) = 0;
+        virtual void leave(const Node& /*node*/, bool /*last*/) {}
+    };
+
+    // traverses tree once passing events to all writers
+    void export_traverse(const Tree& tree, const std::vector<ExportWriter*>& writers);
+    // the same but begin() and end() are not called
+    void export_traverse_subtree(const Node& root, const std::vector<ExportWriter*>& writers);
+
+    // exports tree into multiple files in one traversal, every output is written (and compressed) in its own thread as data is produced
+    // formats that cannot be streamed (.bz2, chunked html) are exported by export_tree()
+    void export_trees(const std::vector<std::string_view>& filenames, const Tree& tree, const ExportOptions& options);
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
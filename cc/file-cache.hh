@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+#include "acmacs-base/filesystem.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    // Keeps objects (trees, charts) imported from files to share them between batch jobs and served requests,
+    // object is imported again if modification time of its file changed.
+    // Ptr is a shared pointer to the imported object, the object must not be modified by users.
+    template <typename Ptr> class FileCache
+    {
+      public:
+        using loader_t = std::function<Ptr(std::string_view filename)>;
+
+        FileCache(loader_t loader) : loader_{std::move(loader)} {}
+
+        Ptr get(std::string_view filename)
+        {
+            if (filename == "-") // stdin cannot be cached
+                return loader_(filename);
+
+            std::shared_ptr<entry_t> entry;
+            {
+                std::unique_lock lock{access_};
+                if (const auto found = entries_.find(filename); found != entries_.end())
+                    entry = found->second;
+                else
+                    entry = entries_.emplace(std::string{filename}, std::make_shared<entry_t>()).first->second;
+            }
+
+            // different files are imported concurrently, the same file just once
+            std::unique_lock lock{entry->access};
+            if (const auto modified = fs::last_write_time(filename); !entry->object || entry->modified != modified) {
+                entry->object = loader_(filename);
+                entry->modified = modified;
+            }
+            return entry->object;
+        }
+
+      private:
+        struct entry_t
+        {
+            std::mutex access;
+            fs::file_time_type modified;
+            Ptr object;
+        };
+
+        loader_t loader_;
+        std::mutex access_;
+        std::map<std::string, std::shared_ptr<entry_t>, std::less<>> entries_;
+    };
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,111 @@
+#include <cerrno>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "acmacs-base/fmt.hh"
+#include "acmacs-base/filesystem.hh"
+#include "acmacs-tal/file-watch.hh"
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::FileWatch::FileWatch()
+    : fd_{::inotify_init1(IN_CLOEXEC)}
+{
+    if (fd_ < 0)
+        throw FileWatchError{fmt::format("inotify_init1 failed: {}", std::strerror(errno))};
+
+} // acmacs::tal::v3::FileWatch::FileWatch
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::FileWatch::~FileWatch()
+{
+    if (fd_ >= 0)
+        ::close(fd_);
+
+} // acmacs::tal::v3::FileWatch::~FileWatch
+
+// ----------------------------------------------------------------------
+
+size_t acmacs::tal::v3::FileWatch::add(std::string_view filename)
+{
+    const auto index = watched_.size();
+    if (filename.empty()) {
+        watched_.push_back(watched_t{-1, std::string{}});
+        return index;
+    }
+
+    const fs::path path{filename};
+    auto directory = path.parent_path();
+    if (directory.empty())
+        directory = ".";
+    // the same directory watched for several files gets the same watch descriptor
+    const int wd = ::inotify_add_watch(fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+        throw FileWatchError{fmt::format("cannot watch {}: {}", directory.native(), std::strerror(errno))};
+    watched_.push_back(watched_t{wd, path.filename().native()});
+    return index;
+
+} // acmacs::tal::v3::FileWatch::add
+
+// ----------------------------------------------------------------------
+
+bool acmacs::tal::v3::FileWatch::read_events(std::vector<size_t>& changed)
+{
+    alignas(inotify_event) std::array<char, 4096> buffer;
+    const auto bytes = ::read(fd_, buffer.data(), buffer.size());
+    if (bytes < 0) {
+        if (errno == EINTR)
+            return false;
+        throw FileWatchError{fmt::format("reading inotify events failed: {}", std::strerror(errno))};
+    }
+
+    for (const char* ptr = buffer.data(); ptr < buffer.data() + bytes;) {
+        const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+        if (event->len > 0) {
+            const std::string_view name{event->name}; // null terminated, padded with nulls up to len
+            for (size_t index = 0; index < watched_.size(); ++index) {
+                if (watched_[index].directory == event->wd && watched_[index].name == name)
+                    changed.push_back(index);
+            }
+        }
+        ptr += sizeof(inotify_event) + event->len;
+    }
+    return true;
+
+} // acmacs::tal::v3::FileWatch::read_events
+
+// ----------------------------------------------------------------------
+
+std::vector<size_t> acmacs::tal::v3::FileWatch::wait(std::chrono::milliseconds settle)
+{
+    std::vector<size_t> changed;
+    while (changed.empty()) {
+        if (!read_events(changed))
+            return {};
+    }
+
+    for (;;) {
+        pollfd to_poll{.fd = fd_, .events = POLLIN, .revents = 0};
+        if (const auto ready = ::poll(&to_poll, 1, static_cast<int>(settle.count())); ready == 0)
+            break;
+        else if (ready < 0) {
+            if (errno == EINTR)
+                return {};
+            throw FileWatchError{fmt::format("polling inotify events failed: {}", std::strerror(errno))};
+        }
+        if (!read_events(changed))
+            return {};
+    }
+
+    std::sort(std::begin(changed), std::end(changed));
+    changed.erase(std::unique(std::begin(changed), std::end(changed)), std::end(changed));
+    return changed;
+
+} // acmacs::tal::v3::FileWatch::wait
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <stdexcept>
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    class FileWatchError : public std::runtime_error { public: using std::runtime_error::runtime_error; };
+
+    // Watches files via inotify on their directories, editors often save by writing a new file and renaming it over the old one.
+    class FileWatch
+    {
+      public:
+        FileWatch();
+        FileWatch(const FileWatch&) = delete;
+        FileWatch& operator=(const FileWatch&) = delete;
+        ~FileWatch();
+
+        // returns index of the file for the result of wait(), empty filename is ignored and not reported
+        size_t add(std::string_view filename);
+
+        // Blocks until at least one of the files is written or replaced, then waits until there are no events during settle
+        // (an editor may write in several steps). Returns indexes of changed files, sorted, empty if interrupted by a signal.
+        std::vector<size_t> wait(std::chrono::milliseconds settle = std::chrono::milliseconds{200});
+
+      private:
+        struct watched_t
+        {
+            int directory; // inotify watch descriptor
+            std::string name;
+        };
+
+        int fd_{-1};
+        std::vector<watched_t> watched_;
+
+        // returns false if interrupted by a signal
+        bool read_events(std::vector<size_t>& changed);
+    };
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
@@ -1,30 +1,274 @@
+#include <deque>
+#include <unordered_map>
+
 #include "acmacs-base/fmt.hh"
-#include "acmacs-base/string-join.hh"
+#include "acmacs-base/filesystem.hh"
+#include "acmacs-tal/log.hh"
 #include "acmacs-tal/html-export.hh"
+#include "acmacs-tal/json-export.hh"
+#include "acmacs-tal/export-pipeline.hh"
+#include "acmacs-tal/output-sink.hh"
 #include "acmacs-tal/tree.hh"
-#include "acmacs-tal/tree-iterate.hh"
 
 // ----------------------------------------------------------------------
 
 namespace
 {
+    extern const char* sStyle;
     extern const char* sHeader;
     extern const char* sFooter;
+    extern const char* sChunkedShell;
 } // namespace
 
-using prefix_t = std::vector<std::string>;
-static void add_nodes_html(fmt::memory_buffer& html, const acmacs::tal::v3::Node& node, const acmacs::tal::v3::Node& parent, double edge_scale, prefix_t& prefix, bool last);
-static void add_nodes_text(fmt::memory_buffer& text, const acmacs::tal::v3::Node& node, double edge_step, prefix_t& prefix, bool last);
+namespace
+{
+    // Decides which sub nodes of the chunk root are written into the chunk: sub nodes are visited breadth first, intermediate
+    // nodes fitting into the remaining leaf budget are written with their subtrees, larger ones are expanded (costs 1) while
+    // the budget lasts, the rest become roots of new chunks. Leaves are always in the chunk, nodes without shown children are
+    // written as hidden.
+    void split_chunk(const acmacs::tal::v3::Node& root, size_t chunk_leaves, std::vector<const acmacs::tal::v3::Node*>& chunks,
+                     std::unordered_map<const acmacs::tal::v3::Node*, size_t>& chunk_of)
+    {
+        std::deque<const acmacs::tal::v3::Node*> queue;
+        const auto expand = [&queue](const acmacs::tal::v3::Node& node) {
+            for (const auto& sub_node : node.subtree) {
+                if (sub_node.children_are_shown())
+                    queue.push_back(&sub_node);
+            }
+        };
+
+        size_t remaining{chunk_leaves};
+        expand(root);
+        while (!queue.empty()) {
+            const auto* node = queue.front();
+            queue.pop_front();
+            if (node->is_leaf()) {
+                if (remaining > 0)
+                    --remaining;
+            }
+            else if (node->number_leaves_in_subtree() <= remaining) {
+                remaining -= node->number_leaves_in_subtree();
+            }
+            else if (remaining > 0) {
+                --remaining;
+                expand(*node);
+            }
+            else {
+                chunk_of.emplace(node, chunks.size());
+                chunks.push_back(node);
+            }
+        }
+    }
+
+    // text tree indentation: concatenated per level fragments, each fragment ends with the level marker (+ | \ space)
+    // kept in one string to avoid joining fragments for every node
+    class text_prefix_t
+    {
+      public:
+        bool empty() const { return levels_.empty(); }
+        char& marker() { return text_.back(); }
+        std::string_view text() const { return text_; }
+
+        void push(size_t edge)
+        {
+            levels_.push_back(text_.size());
+            text_.append(edge, ' ');
+            text_.push_back('+');
+        }
+
+        void pop()
+        {
+            text_.resize(levels_.back());
+            levels_.pop_back();
+        }
+
+      private:
+        std::string text_;
+        std::vector<size_t> levels_;
+    };
+} // namespace
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    class names_writer : public acmacs::tal::v3::ExportWriter
+    {
+      public:
+        names_writer(acmacs::tal::v3::OutputSink& output) : output_{output} {}
+
+        bool enter(const acmacs::tal::v3::Node& node, bool /*last*/) override
+        {
+            if (node.is_leaf()) {
+                output_.write(*node.seq_id);
+                output_.write('\n');
+            }
+            return true;
+        }
+
+      private:
+        acmacs::tal::v3::OutputSink& output_;
+    };
+
+    // ----------------------------------------------------------------------
+
+    // Subtree is a nested <ul>, shifted by the node edge width, vertical lines are drawn by CSS (li border),
+    // output size and export time are linear in the number of nodes
+    class html_writer : public acmacs::tal::v3::ExportWriter
+    {
+      public:
+        html_writer(acmacs::tal::v3::OutputSink& output) : output_{output} {}
+
+        void begin(const acmacs::tal::v3::Tree& tree) override
+        {
+            tree.cumulative_calculate();
+            edge_scale_ = 1000.0 / tree.max_cumulative_shown().as_number();
+            fmt::print(stderr, ">>>> html export: cumul max {} edge_scale {}\n", tree.max_cumulative_shown(), edge_scale_);
+            output_.format(fmt::runtime(sHeader), fmt::arg("title", fmt::format("{} {}", tree.virus_type(), tree.lineage())), fmt::arg("style", sStyle));
+            root_ = &tree;
+        }
+
+        void end(const acmacs::tal::v3::Tree& /*tree*/) override { output_.write(sFooter); }
+
+        bool enter(const acmacs::tal::v3::Node& node, bool last) override
+        {
+            if (&node != root_ && !node.children_are_shown())
+                return false;
+            const auto edge = static_cast<int>(node.edge_length.as_number() * edge_scale_);
+            output_.format("<li{li_class}><div class='e{node_edge_last}' style='width: {edge}px;'></div>", fmt::arg("li_class", last ? " class='l'" : ""), fmt::arg("node_edge_last", last ? " n" : ""),
+                           fmt::arg("edge", edge));
+            if (node.is_leaf()) {
+                output_.format("<span class='s' style='color: {color_tree_label}'>{seq_id} <span class='b'>{accession_numbers}</span></span></li>\n",
+                               fmt::arg("seq_id", node.seq_id), fmt::arg("color_tree_label", "black" /*node.color_tree_label.to_hex_string()*/),
+                               fmt::arg("accession_numbers", fmt::format("{} {}", node.gisaid().isolate_ids, node.gisaid().sample_ids_by_sample_provider)));
+                return false;
+            }
+            else {
+                // if (node.number_leaves_in_subtree() >= 20) {
+                    // if (const auto rep = node.common_aa_.report(parent.common_aa_); !rep.empty())
+                    //     fmt::format_to_mb(html, "<td class='a'>leaves:{} {}</td>", node.number_leaves_in_subtree(), rep);
+                if (const auto rep = node.aa_transitions_.display(); !rep.empty())
+                    output_.format("<span class='a'>{}leaves:{} {} -- left:{}</span>", node.seq_id.empty() ? std::string{} : fmt::format("[{}] ", node.seq_id), node.number_leaves_in_subtree(), rep, node.node_for_left_aa_transitions_ ? node.node_for_left_aa_transitions_->seq_id : std::string_view{});
+                // }
+                output_.format("\n<ul style='margin-left: {edge}px;'>\n", fmt::arg("edge", edge));
+                return true;
+            }
+        }
+
+        void leave(const acmacs::tal::v3::Node& /*node*/, bool /*last*/) override { output_.write("</ul></li>\n"); }
+
+      private:
+        acmacs::tal::v3::OutputSink& output_;
+        double edge_scale_{1.0};
+        const acmacs::tal::v3::Node* root_{nullptr};
+    };
+
+    // ----------------------------------------------------------------------
+
+    class text_writer : public acmacs::tal::v3::ExportWriter
+    {
+      public:
+        text_writer(acmacs::tal::v3::OutputSink& output) : output_{output} {}
+
+        void begin(const acmacs::tal::v3::Tree& tree) override
+        {
+            tree.cumulative_calculate();
+            edge_step_ = 200.0 / tree.max_cumulative_shown().as_number();
+            fmt::print(stderr, ">>>> text export: cumul max {} edge_step {}\n", tree.max_cumulative_shown(), edge_step_);
+            output_.write("-*- Tal-Text-Tree -*-\n");
+            root_ = &tree;
+        }
+
+        bool enter(const acmacs::tal::v3::Node& node, bool last) override
+        {
+            if (&node != root_) {
+                if (!node.children_are_shown())
+                    return false;
+                if (last)
+                    prefix_.marker() = '\\';
+            }
+
+            const auto aa_transitions = node.aa_transitions_.display();
+            if (node.is_leaf()) {
+                output_.format("{prefix}{edge} \"{seq_id}\" {aa_transitions}{accession_numbers} edge: {edge_val}  cumul: {cumul_val}  v:{vert}\n",
+                               fmt::arg("prefix", prefix_.text()), fmt::arg("edge", std::string(static_cast<size_t>(node.edge_length.as_number() * edge_step_), '-')),
+                               fmt::arg("seq_id", node.seq_id),
+                               fmt::arg("accession_numbers", format_accession_numbers(node)),
+                               fmt::arg("edge_val", node.edge_length.as_number()),
+                               fmt::arg("cumul_val", node.cumulative_edge_length.as_number()),
+                               fmt::arg("vert", node.node_id.vertical),
+                               fmt::arg("aa_transitions", aa_transitions.empty() ? std::string{} : fmt::format("[{}] ", aa_transitions))
+                              );
+                return false;
+            }
+            else {
+                const auto edge = static_cast<size_t>(node.edge_length.as_number() * edge_step_);
+                output_.format("{prefix}{edge}\\ >>>> leaves: {leaves}{aa_transitions}",                                         //
+                               fmt::arg("prefix", prefix_.text()),                                                         //
+                               fmt::arg("edge", std::string(edge, '=')),                                                   //
+                               fmt::arg("leaves", node.number_leaves_in_subtree()),                                        //
+                               fmt::arg("aa_transitions", aa_transitions.empty() ? std::string{} : fmt::format(" [{}]", aa_transitions)));
+                output_.format(" node_id: {} edge: {}  cumul: {}\n", node.node_id, node.edge_length.as_number(), node.cumulative_edge_length.as_number());
+                if (!prefix_.empty()) {
+                    if (prefix_.marker() == '\\')
+                        prefix_.marker() = ' ';
+                    else if (prefix_.marker() == '+')
+                        prefix_.marker() = '|';
+                }
+                prefix_.push(edge);
+                return true;
+            }
+        }
+
+        void leave(const acmacs::tal::v3::Node& /*node*/, bool /*last*/) override
+        {
+            prefix_.pop();
+            if (!prefix_.empty() && prefix_.marker() == '|')
+                prefix_.marker() = '+';
+        }
+
+      private:
+        acmacs::tal::v3::OutputSink& output_;
+        double edge_step_{1.0};
+        const acmacs::tal::v3::Node* root_{nullptr};
+        text_prefix_t prefix_;
+
+        static std::string format_accession_numbers(const acmacs::tal::v3::Node& node)
+        {
+            std::string result;
+            if (!node.gisaid().isolate_ids.empty()) {
+                if (!result.empty())
+                    result += " ";
+                result += fmt::format("{}", node.gisaid().isolate_ids);
+            }
+            if (!node.gisaid().sample_ids_by_sample_provider.empty()) {
+                if (!result.empty())
+                    result += " ";
+                result += fmt::format("{}", node.gisaid().sample_ids_by_sample_provider);
+            }
+            return result;
+        }
+    };
+
+    // ----------------------------------------------------------------------
+
+    template <typename Writer> std::string export_to_string(const acmacs::tal::v3::Tree& tree)
+    {
+        std::string result;
+        acmacs::tal::v3::StringSink output{result};
+        Writer writer{output};
+        acmacs::tal::v3::export_traverse(tree, {&writer});
+        output.close();
+        return result;
+    }
+
+} // namespace
 
 // ----------------------------------------------------------------------
 
 std::string acmacs::tal::v3::names_export(const Tree& tree)
 {
-    fmt::memory_buffer names;
-    tree::iterate_leaf(tree, [&names](const auto& node) {
-        fmt::format_to_mb(names, "{}\n", node.seq_id);
-    });
-    return fmt::to_string(names);
+    return export_to_string<names_writer>(tree);
 
 } // acmacs::tal::v3::names_export
 
@@ -32,79 +276,96 @@ std::string acmacs::tal::v3::names_export(const Tree& tree)
 
 std::string acmacs::tal::v3::html_export(const Tree& tree)
 {
-    tree.cumulative_calculate();
-    const double edge_scale = 1000.0 / tree.max_cumulative_shown().as_number();
-    fmt::print(stderr, ">>>> html export: cumul max {} edge_scale {}\n", tree.max_cumulative_shown(), edge_scale);
-
-    fmt::memory_buffer html;
-    fmt::format_to_mb(html, fmt::runtime(sHeader), fmt::arg("title", fmt::format("{} {}", tree.virus_type(), tree.lineage())));
-    prefix_t prefix;
-    add_nodes_html(html, tree, tree, edge_scale, prefix, false);
-    fmt::format_to_mb(html, "{}", sFooter);
-    return fmt::to_string(html);
+    return export_to_string<html_writer>(tree);
 
 } // acmacs::tal::v3::html_export
 
 // ----------------------------------------------------------------------
 
-void add_nodes_html(fmt::memory_buffer& html, const acmacs::tal::v3::Node& node, const acmacs::tal::v3::Node& /*parent*/, double edge_scale, prefix_t& prefix, bool last)
+std::unique_ptr<acmacs::tal::v3::ExportWriter> acmacs::tal::v3::names_export_writer(OutputSink& output)
 {
-    if (node.is_leaf()) {
-        fmt::format_to_mb(html,
-                       "<li><table><tr>{prefix}<td><div class='e {node_edge_last}' style='width: {edge}px;'></div></td><td class='s' style='color: "
-                       "{color_tree_label}'>{seq_id} <span class='b'>{accession_numbers}</span></td></tr></table></li>\n",
-                       fmt::arg("prefix", acmacs::string::join(acmacs::string::join_concat, prefix)), fmt::arg("node_edge_last", last ? "n" : ""),
-                       fmt::arg("edge", static_cast<int>(node.edge_length.as_number() * edge_scale)), fmt::arg("seq_id", node.seq_id),
-                       fmt::arg("color_tree_label", "black" /*node.color_tree_label.to_hex_string()*/),
-                       fmt::arg("accession_numbers", fmt::format("{} {}", node.gisaid.isolate_ids, node.gisaid.sample_ids_by_sample_provider))
-                       );
-    }
-    else {
-        const auto edge = static_cast<int>(node.edge_length.as_number() * edge_scale);
-        fmt::format_to_mb(html, "<li><table><tr>{prefix}<td><div class='e {node_edge_last}' style='width: {edge}px;'></div></td>", fmt::arg("prefix", acmacs::string::join(acmacs::string::join_concat, prefix)),
-                       fmt::arg("node_edge_last", last ? "n" : ""), fmt::arg("edge", edge));
-        // if (node.number_leaves_in_subtree() >= 20) {
-            // if (const auto rep = node.common_aa_.report(parent.common_aa_); !rep.empty())
-            //     fmt::format_to_mb(html, "<td class='a'>leaves:{} {}</td>", node.number_leaves_in_subtree(), rep);
-        if (const auto rep = node.aa_transitions_.display(); !rep.empty())
-            fmt::format_to_mb(html, "<td class='a'>{}leaves:{} {} -- left:{}</td>", node.seq_id.empty() ? std::string{} : fmt::format("[{}] ", node.seq_id), node.number_leaves_in_subtree(), rep, node.node_for_left_aa_transitions_ ? node.node_for_left_aa_transitions_->seq_id : std::string_view{});
-        // }
-        fmt::format_to_mb(html, "</tr></table></li>\n");
-        prefix.push_back(fmt::format("<td class='subnode m'><div style='width: {edge}px;'></div></td>", fmt::arg("edge", edge)));
-        for (auto subnode = std::begin(node.subtree); subnode != std::end(node.subtree); ++subnode) {
-            if (subnode->children_are_shown()) {
-                const auto sub_last = std::next(subnode) == std::end(node.subtree);
-                if (sub_last)
-                    prefix.back() = ::string::replace(prefix.back(), "m", "l");
-                add_nodes_html(html, *subnode, node, edge_scale, prefix, sub_last);
-            }
-        }
-        prefix.pop_back();
+    return std::make_unique<names_writer>(output);
+
+} // acmacs::tal::v3::names_export_writer
+
+// ----------------------------------------------------------------------
+
+std::unique_ptr<acmacs::tal::v3::ExportWriter> acmacs::tal::v3::html_export_writer(OutputSink& output)
+{
+    return std::make_unique<html_writer>(output);
+
+} // acmacs::tal::v3::html_export_writer
+
+// ----------------------------------------------------------------------
+
+std::unique_ptr<acmacs::tal::v3::ExportWriter> acmacs::tal::v3::text_export_writer(OutputSink& output)
+{
+    return std::make_unique<text_writer>(output);
+
+} // acmacs::tal::v3::text_export_writer
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::html_chunked_export(std::string_view filename, const Tree& tree, size_t chunk_leaves)
+{
+    tree.cumulative_calculate();
+    const double edge_scale = 1000.0 / tree.max_cumulative_shown().as_number();
+    const auto chunks_dir = fmt::format("{}.chunks", filename);
+    // chunks are written into a new directory replacing the old one when done, stale chunks of the previous export are removed
+    const auto chunks_dir_new = fmt::format("{}.new", chunks_dir);
+    fs::remove_all(chunks_dir_new);
+    fs::create_directories(chunks_dir_new);
+
+    // chunk 0 is the whole tree, every chunk has about chunk_leaves leaves, subtrees not fitting into it are written into separate chunks
+    std::vector<const Node*> chunks{&tree};
+    std::unordered_map<const Node*, size_t> chunk_of;
+    const json_chunk_id_t chunk_id = [&chunk_of](const Node& node) -> std::optional<size_t> {
+        if (const auto found = chunk_of.find(&node); found != chunk_of.end())
+            return found->second;
+        return std::nullopt;
+    };
+    for (size_t chunk_no = 0; chunk_no < chunks.size(); ++chunk_no) {
+        split_chunk(*chunks[chunk_no], chunk_leaves, chunks, chunk_of);
+        auto output = make_output_sink(fmt::format("{}/chunk-{}.js", chunks_dir_new, chunk_no), compress_output::no);
+        output->format("tal_chunk({}, ", chunk_no);
+        json_export_subtree(*output, *chunks[chunk_no], chunk_id);
+        output->write(");\n");
+        output->close();
     }
+    fs::remove_all(chunks_dir);
+    fs::rename(chunks_dir_new, chunks_dir);
+    AD_INFO("html chunked export: {} chunks in {}", chunks.size(), chunks_dir);
+
+    auto shell = make_output_sink(filename, compress_output::no);
+    shell->format(fmt::runtime(sChunkedShell), fmt::arg("title", fmt::format("{} {}", tree.virus_type(), tree.lineage())), fmt::arg("style", sStyle), fmt::arg("edge_scale", edge_scale),
+                  fmt::arg("chunks", fs::path{chunks_dir}.filename().string()));
+    shell->close();
 
-} // add_nodes
+} // acmacs::tal::v3::html_chunked_export
 
 // ----------------------------------------------------------------------
 
 namespace
 {
+    const char* sStyle = R"(
+   ul.tree, ul.tree ul { list-style: none; margin: 0; padding: 0; }
+   ul.tree li { white-space: nowrap; }
+   ul.tree ul > li { border-left: 1px solid black; }                /* vertical line to the next sibling */
+   ul.tree ul > li.l { border-left: none; }                         /* subnode-last */
+   ul.tree span.a { color: blue; font-size: 0.8em; }                /* common-aa */
+   ul.tree div.e { display: inline-block; vertical-align: top; height: 0.5em; border-bottom: 1px solid black; } /* node-edge */
+   ul.tree div.n { border-left: 1px solid black; }                  /* node-edge-last */
+   ul.tree span.s span.b { color: #808080; }                        /* seq-name, accession_numbers */
+   ul.tree span.k { color: blue; cursor: pointer; }                 /* not loaded chunk */
+)";
+
     const char* sHeader = R"(
 <!DOCTYPE html>
 <html>
  <head>
   <title>{title}</title>
   <style>
-   ul.tree {{ list-style: none; margin: 0; padding: 0; }}
-   ul.tree > li {{ white-space: nowrap; }}
-   ul.tree table {{ border-collapse: collapse; }}
-   ul.tree td {{ padding: 0; vertical-align: top; }}
-   ul.tree td.m {{ border-right: 1px solid black; }}                  /* subnode-middle */
-   ul.tree td.l {{ border-right: none; }}                             /* subnode-last */
-   ul.tree td.a {{ color: blue; font-size: 0.8em; }}                  /* common-aa */
-   ul.tree div.e {{ height: 0.5em; border-bottom: 1px solid black; }} /* node-edge */
-   ul.tree div.n {{ border-left: 1px solid black; }}                  /* node-edge-last */
-   ul.tree td.s span.b {{ color: #808080; }}                          /* seq-name, accession_numbers */
-  </style>
+{style}  </style>
  </head>
  <body>
   <h1>{title}</h1>
@@ -117,83 +378,78 @@ namespace
 <html>
 )";
 
-} // namespace
+    // chunk files are scripts calling tal_chunk() (instead of plain json loaded by fetch) to allow viewing from file:// urls
+    const char* sChunkedShell = R"(
+<!DOCTYPE html>
+<html>
+ <head>
+  <title>{title}</title>
+  <style>{style}</style>
+  <script>
+   const tal = {{ edge_scale: {edge_scale}, chunks: "{chunks}", pending: {{}} }};
 
-// ----------------------------------------------------------------------
+   function tal_chunk(chunk_no, node) {{
+       const target = tal.pending[chunk_no];
+       delete tal.pending[chunk_no];
+       target.replaceWith(tal_node(node, target.classList.contains("l")));
+   }}
 
-std::string acmacs::tal::v3::text_export(const Tree& tree)
-{
-    tree.cumulative_calculate();
-    const double edge_step = 200.0 / tree.max_cumulative_shown().as_number();
-    fmt::print(stderr, ">>>> text export: cumul max {} edge_step {}\n", tree.max_cumulative_shown(), edge_step);
+   function tal_load(chunk_no, target) {{
+       tal.pending[chunk_no] = target;
+       const script = document.createElement("script");
+       script.src = `${{tal.chunks}}/chunk-${{chunk_no}}.js`;
+       document.head.appendChild(script);
+   }}
 
-    fmt::memory_buffer text;
-    fmt::format_to_mb(text, "-*- Tal-Text-Tree -*-\n");
-    prefix_t prefix;
-    add_nodes_text(text, tree, edge_step, prefix, false);
-    return fmt::to_string(text);
+   function tal_node(node, last) {{
+       const li = document.createElement("li");
+       if (last)
+           li.className = "l";
+       const edge = document.createElement("div");
+       edge.className = last ? "e n" : "e";
+       edge.style.width = `${{Math.round((node.l || 0) * tal.edge_scale)}}px`;
+       li.appendChild(edge);
+       if (node.k !== undefined) {{
+           const label = document.createElement("span");
+           label.className = "k";
+           label.textContent = `[+] leaves: ${{node.s}}`;
+           label.onclick = () => {{ label.textContent = "loading..."; label.onclick = null; tal_load(node.k, li); }};
+           li.appendChild(label);
+       }}
+       else if (node.t) {{
+           const ul = document.createElement("ul");
+           ul.style.marginLeft = edge.style.width;
+           const shown = node.t.filter(sub => !sub.H);
+           shown.forEach((sub, no) => ul.appendChild(tal_node(sub, no === (shown.length - 1))));
+           li.appendChild(ul);
+       }}
+       else {{
+           const label = document.createElement("span");
+           label.className = "s";
+           label.textContent = node.d ? `${{node.n}} ${{node.d}}` : node.n;
+           li.appendChild(label);
+       }}
+       return li;
+   }}
 
-} // acmacs::tal::v3::text_export
+   window.addEventListener("load", () => tal_load(0, document.getElementById("tal-root")));
+  </script>
+ </head>
+ <body>
+  <h1>{title}</h1>
+  <ul class="tree"><li id="tal-root"></li></ul>
+ </body>
+</html>
+)";
+
+} // namespace
 
 // ----------------------------------------------------------------------
 
-void add_nodes_text(fmt::memory_buffer& text, const acmacs::tal::v3::Node& node, double edge_step, prefix_t& prefix, bool /*last*/)
+std::string acmacs::tal::v3::text_export(const Tree& tree)
 {
-    const auto format_accession_numbers = [](const auto& aNode) {
-        std::string result;
-        if (!aNode.gisaid.isolate_ids.empty()) {
-            if (!result.empty())
-                result += " ";
-            result += fmt::format("{}", aNode.gisaid.isolate_ids);
-        }
-        if (!aNode.gisaid.sample_ids_by_sample_provider.empty()) {
-            if (!result.empty())
-                result += " ";
-            result += fmt::format("{}", aNode.gisaid.sample_ids_by_sample_provider);
-        }
-        return result;
-    };
+    return export_to_string<text_writer>(tree);
 
-    const auto aa_transitions = node.aa_transitions_.display();
-    if (node.is_leaf()) {
-        fmt::format_to_mb(text, "{prefix}{edge} \"{seq_id}\" {aa_transitions}{accession_numbers} edge: {edge_val}  cumul: {cumul_val}  v:{vert}\n",
-                       fmt::arg("prefix", acmacs::string::join(acmacs::string::join_concat, prefix)), fmt::arg("edge", std::string(static_cast<size_t>(node.edge_length.as_number() * edge_step), '-')),
-                       fmt::arg("seq_id", node.seq_id),
-                       fmt::arg("accession_numbers", format_accession_numbers(node)),
-                       fmt::arg("edge_val", node.edge_length.as_number()),
-                       fmt::arg("cumul_val", node.cumulative_edge_length.as_number()),
-                       fmt::arg("vert", node.node_id.vertical),
-                       fmt::arg("aa_transitions", aa_transitions.empty() ? std::string{} : fmt::format("[{}] ", aa_transitions))
-                      );
-    }
-    else {
-        const auto edge = static_cast<size_t>(node.edge_length.as_number() * edge_step);
-        fmt::format_to_mb(text, "{prefix}{edge}\\ >>>> leaves: {leaves}{aa_transitions}",                        //
-                       fmt::arg("prefix", acmacs::string::join(acmacs::string::join_concat, prefix)),                              //
-                       fmt::arg("edge", std::string(edge, '=')),                                                                   //
-                       fmt::arg("leaves", node.number_leaves_in_subtree()),                                                        //
-                       fmt::arg("aa_transitions", aa_transitions.empty() ? std::string{} : fmt::format(" [{}]", aa_transitions)));
-        fmt::format_to_mb(text, " node_id: {} edge: {}  cumul: {}\n", node.node_id, node.edge_length.as_number(), node.cumulative_edge_length.as_number());
-        if (!prefix.empty()) {
-            if (prefix.back().back() == '\\')
-                prefix.back().back() = ' ';
-            else if (prefix.back().back() == '+')
-                prefix.back().back() = '|';
-        }
-        prefix.push_back(std::string(edge, ' ') + "+");
-        for (auto subnode = std::begin(node.subtree); subnode != std::end(node.subtree); ++subnode) {
-            if (subnode->children_are_shown()) {
-                const auto sub_last = std::next(subnode) == std::end(node.subtree);
-                if (sub_last)
-                    prefix.back().back() = '\\';
-                add_nodes_text(text, *subnode, edge_step, prefix, sub_last);
-            }
-        }
-        prefix.pop_back();
-        if (!prefix.empty() && prefix.back().back() == '|')
-            prefix.back().back() = '+';
-    }
-
-} // add_nodes_text
+} // acmacs::tal::v3::text_export
 
 // ----------------------------------------------------------------------
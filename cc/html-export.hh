@@ -1,6 +1,8 @@
 #pragma once
 
 #include <string>
+#include <string_view>
+#include <memory>
 
 // ----------------------------------------------------------------------
 
@@ -9,10 +11,19 @@ namespace acmacs::tal::inline v3
     class HtmlExportError : public std::runtime_error { public: using std::runtime_error::runtime_error; };
 
     class Tree;
+    class OutputSink;
+    class ExportWriter;
 
     std::string html_export(const Tree& tree);
+    // writes html page (filename) and subtree chunks (filename.chunks/chunk-N.js) loaded by the page when subtree is expanded
+    void html_chunked_export(std::string_view filename, const Tree& tree, size_t chunk_leaves);
     std::string names_export(const Tree& tree);
     std::string text_export(const Tree& tree);
+
+    // for export_traverse()
+    std::unique_ptr<ExportWriter> html_export_writer(OutputSink& output);
+    std::unique_ptr<ExportWriter> names_export_writer(OutputSink& output);
+    std::unique_ptr<ExportWriter> text_export_writer(OutputSink& output);
 }
 
 // ----------------------------------------------------------------------
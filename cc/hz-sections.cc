@@ -35,6 +35,7 @@ void acmacs::tal::v3::HzSections::prepare(preparation_stage_t stage)
         // auto& layout = tal().draw().layout();
         if (parameters().report)
             report();
+        tal().tree().artifacts().computed(artifact_t::hz_sections);
     }
     LayoutElement::prepare(stage);
 
@@ -236,7 +237,7 @@ void acmacs::tal::v3::HzSections::report() const
 void acmacs::tal::v3::HzSectionMarker::prepare(preparation_stage_t stage)
 {
     if (stage == 2 && prepared_ < stage) {
-        tal().draw().layout().prepare_element<HzSections>(stage);
+        require(artifact_t::hz_sections);
         if (const auto* hz_sections = tal().draw().layout().find<HzSections>(); !hz_sections || hz_sections->sections().empty())
             width_to_height_ratio() = 0.0;
     }
@@ -6,6 +6,7 @@
 #include "acmacs-tal/json-import.hh"
 #include "acmacs-tal/json-export.hh"
 #include "acmacs-tal/html-export.hh"
+#include "acmacs-tal/output-sink.hh"
 #include "acmacs-tal/tree.hh"
 
 // ----------------------------------------------------------------------
@@ -56,19 +57,36 @@ void acmacs::tal::v3::export_tree(std::string_view filename, const Tree& tree, c
     }
     else if (filename == "/json" || ext == ".json" || ext == ".tjz") {
         try {
+            if (filepath.extension() != ".bz2") {
+                // stream directly to the file, the whole json text is not kept in memory
+                auto output = make_output_sink(filename == "/json" ? std::string_view{"-"} : filename, filename.back() == 'z' ? compress_output::xz : compress_output::no, options.compression_threads);
+                json_export(*output, tree);
+                output->close();
+                return;
+            }
             exported = json_export(tree);
         }
         catch (JsonExportError& err) {
             throw ExportError{fmt::format("cannot export to json: {}", err)};
         }
+        catch (OutputError& err) {
+            throw ExportError{fmt::format("cannot export to json: {}", err)};
+        }
     }
     else if (ext == ".html") {
         try {
+            if (options.html_chunk_leaves > 0) {
+                html_chunked_export(filename, tree, options.html_chunk_leaves);
+                return;
+            }
             exported = html_export(tree);
         }
         catch (JsonExportError& err) {
             throw ExportError{fmt::format("cannot export to html: {}", err)};
         }
+        catch (OutputError& err) {
+            throw ExportError{fmt::format("cannot export to html: {}", err)};
+        }
     }
     else if (ext == ".txt" || ext == ".text") {
         try {
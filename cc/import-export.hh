@@ -15,6 +15,9 @@ namespace acmacs::tal::inline v3
     struct ExportOptions
     {
         bool add_aa_substitution_labels{false}; // newick export, SARS
+        size_t export_threads{0};               // parallel formatting of subtrees (newick), 0 - number of hardware threads
+        size_t compression_threads{1};          // xz compression of json export, 0 - number of hardware threads
+        size_t html_chunk_leaves{0};            // html export: 0 - single page, otherwise page and subtree chunks loaded on demand, about that many leaves per chunk
     };
 
     void import_tree(std::string_view filename, Tree& tree);
@@ -1,55 +1,278 @@
-#include "acmacs-base/to-json.hh"
 #include "acmacs-base/date.hh"
 #include "acmacs-base/timeit.hh"
 #include "acmacs-tal/json-export.hh"
+#include "acmacs-tal/export-pipeline.hh"
+#include "acmacs-tal/output-sink.hh"
 #include "acmacs-tal/tree.hh"
 
-static to_json::object export_node(const acmacs::tal::v3::Node& node);
+// ----------------------------------------------------------------------
+
+namespace
+{
+    // Writes tree in the phylogenetic-tree-v3 format directly to the output during tree traversal,
+    // layout is the same as produced by to_json::object formatted with the same indent
+    class json_writer : public acmacs::tal::v3::ExportWriter
+    {
+      public:
+        json_writer(acmacs::tal::v3::OutputSink& output, size_t indent) : output_{output}, indent_{indent}, root_level_{1} {}
+        json_writer(acmacs::tal::v3::OutputSink& output, size_t indent, const acmacs::tal::v3::json_chunk_id_t& chunk_id)
+            : output_{output}, indent_{indent}, root_level_{0}, chunk_id_{&chunk_id}, sequences_{false}
+        {
+        }
+
+        void begin(const acmacs::tal::v3::Tree& tree) override
+        {
+            tree.cumulative_calculate();
+            output_.write('{');
+            first_field_ = true;
+            // the first field is on the same line with the opening brace (emacs mode line)
+            string_field("_", fmt::format("-*- js-indent-level: {} -*-", indent_), 1);
+            string_field("  version", "phylogenetic-tree-v3", 1);
+            string_field("  date", date::current_date_time(), 1);
+            string_field_if_not_empty("v", tree.virus_type(), 1);
+            string_field_if_not_empty("l", tree.lineage(), 1);
+            key("tree", 1);
+        }
+
+        void end(const acmacs::tal::v3::Tree& /*tree*/) override
+        {
+            close('}', 0);
+            if (indent_ > 0)
+                output_.write('\n');
+        }
+
+        bool enter(const acmacs::tal::v3::Node& node, bool /*last*/) override
+        {
+            const auto level = current_level();
+            if (!subtree_started_.empty()) {
+                // not a root, "t" of the parent node is written on the first child
+                if (!subtree_started_.back()) {
+                    key("t", level - 1);
+                    output_.write('[');
+                    subtree_started_.back() = true;
+                }
+                else
+                    output_.write(',');
+                newline(level);
+                if (chunk_id_) {
+                    if (!node.children_are_shown()) { // html viewer skips it, neither its data nor a chunk for it are needed
+                        hidden_reference(level);
+                        return false;
+                    }
+                    if (const auto chunk = (*chunk_id_)(node); chunk.has_value()) {
+                        chunk_reference(node, *chunk, level);
+                        return false;
+                    }
+                }
+            }
+
+            output_.write('{');
+            first_field_ = true;
+            const auto field_level = level + 1;
+            if (node.is_leaf()) {
+                string_field("n", *node.seq_id, field_level);
+                if (node.hidden) {
+                    key("H", field_level);
+                    output_.write("true");
+                }
+                if (sequences_) {
+                    string_field_if_not_empty("a", *node.aa_sequence, field_level);
+                    string_field_if_not_empty("N", *node.nuc_sequence, field_level);
+                }
+                string_field_if_not_empty("d", node.date, field_level);
+                string_field_if_not_empty("C", node.continent, field_level);
+                string_field_if_not_empty("D", node.country, field_level);
+                if (const auto hi_names = node.hi_names(); !hi_names.empty()) {
+                    key("h", field_level);
+                    output_.write('[');
+                    for (auto hi_name = std::begin(hi_names); hi_name != std::end(hi_names); ++hi_name) {
+                        if (hi_name != std::begin(hi_names))
+                            output_.write(indent_ > 0 ? ", " : ",");
+                        string(*hi_name);
+                    }
+                    output_.write(']');
+                }
+            }
+            if (!node.edge_length.is_zero()) {
+                key("l", field_level);
+                output_.format("{}", node.edge_length);
+            }
+            if (node.cumulative_edge_length >= acmacs::tal::v3::EdgeLength{0.0}) {
+                key("c", field_level);
+                output_.format("{}", node.cumulative_edge_length);
+            }
+            if (node.subtree.empty()) {
+                close('}', level);
+                return false;
+            }
+            subtree_started_.push_back(false);
+            return true;
+        }
+
+        void leave(const acmacs::tal::v3::Node& /*node*/, bool /*last*/) override
+        {
+            const bool subtree_started = subtree_started_.back();
+            subtree_started_.pop_back();
+            const auto level = current_level();
+            if (subtree_started) {
+                newline(level + 1);
+                output_.write(']');
+                first_field_ = false;
+            }
+            close('}', level);
+        }
+
+      private:
+        acmacs::tal::v3::OutputSink& output_;
+        const size_t indent_;
+        const size_t root_level_;
+        const acmacs::tal::v3::json_chunk_id_t* chunk_id_{nullptr};
+        const bool sequences_{true};
+        bool first_field_{true};
+        std::vector<bool> subtree_started_; // for each entered intermediate node: if "t" was written
+
+        // level of the current node object, node fields are on the next level, subtree elements are two levels deeper
+        size_t current_level() const { return root_level_ + subtree_started_.size() * 2; }
+
+        void chunk_reference(const acmacs::tal::v3::Node& node, size_t chunk, size_t level)
+        {
+            output_.write('{');
+            first_field_ = true;
+            key("k", level + 1);
+            output_.format("{}", chunk);
+            key("s", level + 1);
+            output_.format("{}", node.number_leaves_in_subtree());
+            if (!node.edge_length.is_zero()) {
+                key("l", level + 1);
+                output_.format("{}", node.edge_length);
+            }
+            close('}', level);
+        }
+
+        void hidden_reference(size_t level)
+        {
+            output_.write('{');
+            first_field_ = true;
+            key("H", level + 1);
+            output_.write("true");
+            close('}', level);
+        }
+
+        void key(std::string_view name, size_t level)
+        {
+            if (!first_field_) {
+                output_.write(',');
+                newline(level);
+            }
+            else if (level > 1)
+                newline(level);
+            first_field_ = false;
+            string(name);
+            output_.write(indent_ > 0 ? ": " : ":");
+        }
+
+        void close(char symbol, size_t level)
+        {
+            if (!first_field_)
+                newline(level);
+            output_.write(symbol);
+            first_field_ = false;
+        }
+
+        void newline(size_t level)
+        {
+            if (indent_ > 0) {
+                output_.write('\n');
+                for (size_t sp = 0; sp < level * indent_; ++sp)
+                    output_.write(' ');
+            }
+        }
+
+        void string_field(std::string_view name, std::string_view value, size_t level)
+        {
+            key(name, level);
+            string(value);
+        }
+
+        void string_field_if_not_empty(std::string_view name, std::string_view value, size_t level)
+        {
+            if (!value.empty())
+                string_field(name, value, level);
+        }
+
+        void string(std::string_view value)
+        {
+            output_.write('"');
+            size_t chunk_start{0};
+            for (size_t pos = 0; pos < value.size(); ++pos) {
+                if (const char cc = value[pos]; cc == '"' || cc == '\\' || static_cast<unsigned char>(cc) < 0x20) {
+                    output_.write(value.substr(chunk_start, pos - chunk_start));
+                    switch (cc) {
+                        case '"':
+                            output_.write("\\\"");
+                            break;
+                        case '\\':
+                            output_.write("\\\\");
+                            break;
+                        case '\n':
+                            output_.write("\\n");
+                            break;
+                        case '\t':
+                            output_.write("\\t");
+                            break;
+                        default:
+                            output_.format("\\u{:04x}", static_cast<unsigned>(cc));
+                            break;
+                    }
+                    chunk_start = pos + 1;
+                }
+            }
+            output_.write(value.substr(chunk_start));
+            output_.write('"');
+        }
+    };
+
+} // namespace
 
 // ----------------------------------------------------------------------
 
-std::string acmacs::tal::v3::json_export(const Tree& tree, size_t indent)
+std::unique_ptr<acmacs::tal::v3::ExportWriter> acmacs::tal::v3::json_export_writer(OutputSink& output, size_t indent)
+{
+    return std::make_unique<json_writer>(output, indent);
+
+} // acmacs::tal::v3::json_export_writer
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::json_export(OutputSink& output, const Tree& tree, size_t indent)
 {
     // Timeit ti{"exporting tree to json"};
-    tree.cumulative_calculate();
-    auto json = to_json::object(to_json::key_val("_", fmt::format("-*- js-indent-level: {} -*-", indent)),
-                                to_json::key_val("  version", "phylogenetic-tree-v3"),
-                                to_json::key_val("  date", date::current_date_time()));
-    json << to_json::key_val_if_not_empty("v", tree.virus_type())
-         << to_json::key_val_if_not_empty("l", tree.lineage())
-         << to_json::key_val("tree", export_node(tree));
-    return fmt::format(fmt::runtime(fmt::format("{{:{}}}", indent)), json);
+    json_writer writer{output, indent};
+    export_traverse(tree, {&writer});
 
 } // acmacs::tal::v3::json_export
 
 // ----------------------------------------------------------------------
 
-to_json::object export_node(const acmacs::tal::v3::Node& node)
+void acmacs::tal::v3::json_export_subtree(OutputSink& output, const Node& root, const json_chunk_id_t& chunk_id, size_t indent)
+{
+    json_writer writer{output, indent, chunk_id};
+    export_traverse_subtree(root, {&writer});
+    if (indent > 0)
+        output.write('\n');
+
+} // acmacs::tal::v3::json_export_subtree
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::tal::v3::json_export(const Tree& tree, size_t indent)
 {
-    to_json::object result;
-    if (node.is_leaf()) {
-        result << to_json::key_val("n", *node.seq_id)
-               << to_json::key_val_if_true("H", node.hidden)
-               << to_json::key_val_if_not_empty("a", *node.aa_sequence)
-               << to_json::key_val_if_not_empty("N", *node.nuc_sequence)
-               << to_json::key_val_if_not_empty("d", node.date)
-               << to_json::key_val_if_not_empty("C", node.continent)
-               << to_json::key_val_if_not_empty("D", node.country);
-        if (!node.hi_names.empty())
-            result << to_json::key_val("h", to_json::array(std::begin(node.hi_names), std::end(node.hi_names)));
-    }
-    if (!node.edge_length.is_zero())
-        result << to_json::key_val("l", to_json::raw(node.edge_length.as_string()));
-    if (node.cumulative_edge_length >= acmacs::tal::v3::EdgeLength{0.0})
-        result << to_json::key_val("c", to_json::raw(node.cumulative_edge_length.as_string()));
-    if (!node.subtree.empty()) {
-        to_json::array subtree;
-        for (const auto& sub_node : node.subtree)
-            subtree << export_node(sub_node);
-        result << to_json::key_val("t", std::move(subtree));
-    }
+    std::string result;
+    StringSink output{result};
+    json_export(output, tree, indent);
+    output.close();
     return result;
 
-} // export_node
+} // acmacs::tal::v3::json_export
 
 // ----------------------------------------------------------------------
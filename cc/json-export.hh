@@ -1,6 +1,9 @@
 #pragma once
 
 #include <string>
+#include <optional>
+#include <functional>
+#include <memory>
 
 // ----------------------------------------------------------------------
 
@@ -9,8 +12,19 @@ namespace acmacs::tal::inline v3
     class JsonExportError : public std::runtime_error { public: using std::runtime_error::runtime_error; };
 
     class Tree;
+    class Node;
+    class OutputSink;
+    class ExportWriter;
 
     std::string json_export(const Tree& tree, size_t indent = 1);
+    void json_export(OutputSink& output, const Tree& tree, size_t indent = 1); // streams directly to output without building the whole text in memory
+    std::unique_ptr<ExportWriter> json_export_writer(OutputSink& output, size_t indent = 1); // for export_traverse()
+
+    // Writes node with its subtree using the same node fields as json_export but without sequences.
+    // Sub nodes for which chunk_id returns value are not written, reference is written instead: {"k": <chunk id>, "s": <number of leaves>, "l": <edge>}
+    // Sub nodes with no shown children (hidden leaves and subtrees) are written as {"H": true}
+    using json_chunk_id_t = std::function<std::optional<size_t>(const Node&)>;
+    void json_export_subtree(OutputSink& output, const Node& root, const json_chunk_id_t& chunk_id, size_t indent = 0);
 }
 
 // ----------------------------------------------------------------------
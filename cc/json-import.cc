@@ -125,7 +125,7 @@ namespace
                     reset_key();
                     break;
                 case array_processing::hi_names:
-                    node_.hi_names.push_back(data);
+                    node_.imported_hi_names.push_back(data);
                     break;
                 case array_processing::aa_substs:
                     node_.aa_transitions_.add(data);
@@ -134,7 +134,7 @@ namespace
                     node_.nuc_transitions_.add(data);
                     break;
                 case array_processing::clades:
-                    node_.clades.add(std::string{data});
+                    node_.clades.add(data);
                     break;
                 case array_processing::subnodes:
                     throw in_json::parse_error(fmt::format("unsupported string \"{}\" for key \"{}\"", data, key_));
@@ -207,6 +207,290 @@ namespace
     };
 
     using sink = in_json::object_sink<acmacs::tal::v3::Tree, tree_data>;
+
+    // ----------------------------------------------------------------------
+    // Fast path: the whole document is tokenized into a flat tape first,
+    // then nodes are constructed from the tape, number of children of every
+    // node is known in advance and subtree storage is allocated once.
+    // Strings are views into the data buffer (escape sequences are not decoded, the same as in_json does).
+
+    namespace tape
+    {
+        struct syntax_error : public std::runtime_error { using std::runtime_error::runtime_error; };
+
+        enum class token_type : char { object, array, string, number, true_value, false_value, null_value };
+
+        struct token_t
+        {
+            token_type type;
+            std::string_view text; // string content without quotes, number text
+            size_t end;            // index of the token after this one and all its content
+            size_t size{0};        // number of direct children (keys and values for object)
+        };
+
+        using tape_t = std::vector<token_t>;
+
+        inline tape_t tokenize(std::string_view data)
+        {
+            // what may come next, separators (, and :) are checked by it, so is the key-value structure of objects
+            enum class expect_t { value, value_or_close, key, key_or_close, colon, separator_or_close, end };
+
+            tape_t tape;
+            std::vector<size_t> open;
+            expect_t expect{expect_t::value};
+            const auto in_object = [&tape, &open]() { return !open.empty() && tape[open.back()].type == token_type::object; };
+            const auto add = [&tape, &open](token_type type, std::string_view text) {
+                if (!open.empty())
+                    ++tape[open.back()].size;
+                tape.push_back(token_t{.type = type, .text = text, .end = tape.size() + 1});
+            };
+            const auto value = [&expect, &open, &add](token_type type, std::string_view text, size_t pos) {
+                if (expect == expect_t::end)
+                    throw syntax_error{fmt::format("unexpected data after the top level value at {}", pos)};
+                if (expect != expect_t::value && expect != expect_t::value_or_close)
+                    throw syntax_error{fmt::format("unexpected value at {}", pos)};
+                add(type, text);
+                expect = open.empty() ? expect_t::end : expect_t::separator_or_close;
+            };
+            const auto close = [&tape, &open, &expect](token_type type, size_t pos) {
+                const auto empty_expected = type == token_type::object ? expect_t::key_or_close : expect_t::value_or_close;
+                if (open.empty() || tape[open.back()].type != type || (expect != expect_t::separator_or_close && expect != empty_expected))
+                    throw syntax_error{fmt::format("unexpected closing bracket at {}", pos)};
+                tape[open.back()].end = tape.size();
+                open.pop_back();
+                expect = open.empty() ? expect_t::end : expect_t::separator_or_close;
+            };
+
+            for (size_t pos = 0; pos < data.size(); ++pos) {
+                switch (data[pos]) {
+                    case ' ':
+                    case '\n':
+                    case '\t':
+                    case '\r':
+                        break;
+                    case ',':
+                        if (expect != expect_t::separator_or_close)
+                            throw syntax_error{fmt::format("unexpected comma at {}", pos)};
+                        expect = in_object() ? expect_t::key : expect_t::value;
+                        break;
+                    case ':':
+                        if (expect != expect_t::colon)
+                            throw syntax_error{fmt::format("unexpected colon at {}", pos)};
+                        expect = expect_t::value;
+                        break;
+                    case '{':
+                        value(token_type::object, {}, pos);
+                        open.push_back(tape.size() - 1);
+                        expect = expect_t::key_or_close;
+                        break;
+                    case '[':
+                        value(token_type::array, {}, pos);
+                        open.push_back(tape.size() - 1);
+                        expect = expect_t::value_or_close;
+                        break;
+                    case '}':
+                        close(token_type::object, pos);
+                        break;
+                    case ']':
+                        close(token_type::array, pos);
+                        break;
+                    case '"': {
+                        const auto start = pos + 1;
+                        for (pos = start; pos < data.size() && data[pos] != '"'; ++pos) {
+                            if (data[pos] == '\\')
+                                ++pos;
+                        }
+                        if (pos >= data.size())
+                            throw syntax_error{fmt::format("unterminated string at {}", start - 1)};
+                        if (expect == expect_t::key || expect == expect_t::key_or_close) {
+                            add(token_type::string, data.substr(start, pos - start));
+                            expect = expect_t::colon;
+                        }
+                        else
+                            value(token_type::string, data.substr(start, pos - start), start - 1);
+                    } break;
+                    case 't':
+                        if (data.substr(pos, 4) != "true")
+                            throw syntax_error{fmt::format("unexpected symbol at {}", pos)};
+                        value(token_type::true_value, {}, pos);
+                        pos += 3;
+                        break;
+                    case 'f':
+                        if (data.substr(pos, 5) != "false")
+                            throw syntax_error{fmt::format("unexpected symbol at {}", pos)};
+                        value(token_type::false_value, {}, pos);
+                        pos += 4;
+                        break;
+                    case 'n':
+                        if (data.substr(pos, 4) != "null")
+                            throw syntax_error{fmt::format("unexpected symbol at {}", pos)};
+                        value(token_type::null_value, {}, pos);
+                        pos += 3;
+                        break;
+                    default:
+                        if (data[pos] == '-' || (data[pos] >= '0' && data[pos] <= '9')) {
+                            const auto start = pos;
+                            while (pos < data.size() && (data[pos] == '-' || data[pos] == '+' || data[pos] == '.' || data[pos] == 'e' || data[pos] == 'E' || (data[pos] >= '0' && data[pos] <= '9')))
+                                ++pos;
+                            value(token_type::number, data.substr(start, pos - start), start);
+                            --pos;
+                        }
+                        else
+                            throw syntax_error{fmt::format("unexpected symbol at {}", pos)};
+                        break;
+                }
+            }
+            if (expect != expect_t::end)
+                throw syntax_error{"unexpected end of data"};
+            if (tape.front().type != token_type::object)
+                throw syntax_error{"top level object expected"};
+            return tape;
+        }
+
+        // ----------------------------------------------------------------------
+
+        class builder
+        {
+          public:
+            builder(const tape_t& tape) : tape_{tape} {}
+
+            void tree(acmacs::tal::v3::Tree& tree)
+            {
+                for_each_field(0, [this, &tree](std::string_view key, size_t value) {
+                    const auto& val = tape_[value];
+                    if (key == "tree") {
+                        expect(val, token_type::object, key);
+                        node(tree, value);
+                    }
+                    else if (val.type == token_type::array) {
+                        // ignored, as in_json parser does
+                    }
+                    else if (key == "  version") {
+                        if (val.text != "phylogenetic-tree-v3" && val.text != "newick-tree-v1")
+                            throw acmacs::tal::v3::JsonImportError{fmt::format("tree in json format import error: unsupported version: {}", val.text)};
+                    }
+                    else if (key == "  date" || key == "_") {
+                    }
+                    else if (key == "v")
+                        tree.virus_type(string(val, key));
+                    else if (key == "l")
+                        tree.lineage(string(val, key));
+                    else
+                        unsupported(key);
+                });
+            }
+
+          private:
+            const tape_t& tape_;
+
+            template <typename F> void for_each_field(size_t obj, F&& func) const
+            {
+                for (auto key = obj + 1; key < tape_[obj].end; key = tape_[key + 1].end)
+                    func(tape_[key].text, key + 1);
+            }
+
+            template <typename F> void for_each_element(size_t array, F&& func) const
+            {
+                for (auto element = array + 1; element < tape_[array].end; element = tape_[element].end)
+                    func(element);
+            }
+
+            void node(acmacs::tal::v3::Node& node, size_t obj) const
+            {
+                for_each_field(obj, [this, &node](std::string_view key, size_t value) {
+                    const auto& val = tape_[value];
+                    if (key.size() != 1)
+                        unsupported(key);
+                    switch (key.front()) {
+                        case 'n':
+                            node.seq_id = acmacs::tal::v3::seq_id_t{string(val, key)};
+                            break;
+                        case 'a':
+                            node.aa_sequence = acmacs::seqdb::sequence_aligned_ref_t{string(val, key)};
+                            break;
+                        case 'N':
+                            node.nuc_sequence = acmacs::seqdb::sequence_aligned_ref_t{string(val, key)};
+                            break;
+                        case 'd':
+                            node.date = string(val, key);
+                            break;
+                        case 'C':
+                            node.continent = string(val, key);
+                            break;
+                        case 'D':
+                            node.country = string(val, key);
+                            break;
+                        case 'H':
+                            if (val.type != token_type::true_value && val.type != token_type::false_value)
+                                unsupported(key);
+                            node.hidden = val.type == token_type::true_value;
+                            break;
+                        case 'c':
+                            node.cumulative_edge_length = acmacs::tal::v3::EdgeLength{number(val, key)};
+                            break;
+                        case 'l':
+                            node.edge_length = acmacs::tal::v3::EdgeLength{number(val, key)};
+                            break;
+                        case 'I': // ae node_id_
+                        case 'M': // ae max_cumulative
+                            number(val, key);
+                            break;
+                        case 'L':
+                            if (val.type == token_type::array) {
+                                for_each_element(value, [this, &node, key](size_t element) { node.clades.add(string(tape_[element], key)); });
+                            }
+                            else
+                                number(val, key); // ae number_leaves_in_tree
+                            break;
+                        case 't':
+                            expect(val, token_type::array, key);
+                            node.subtree.reserve(val.size);
+                            for_each_element(value, [this, &node, key](size_t element) {
+                                expect(tape_[element], token_type::object, key);
+                                this->node(node.add_subtree(), element);
+                            });
+                            break;
+                        case 'h':
+                            expect(val, token_type::array, key);
+                            node.imported_hi_names.reserve(val.size);
+                            for_each_element(value, [this, &node, key](size_t element) { node.imported_hi_names.push_back(string(tape_[element], key)); });
+                            break;
+                        case 'A':
+                            expect(val, token_type::array, key);
+                            for_each_element(value, [this, &node, key](size_t element) { node.aa_transitions_.add(string(tape_[element], key)); });
+                            break;
+                        case 'B':
+                            expect(val, token_type::array, key);
+                            for_each_element(value, [this, &node, key](size_t element) { node.nuc_transitions_.add(string(tape_[element], key)); });
+                            break;
+                        default:
+                            unsupported(key);
+                    }
+                });
+            }
+
+            static std::string_view string(const token_t& token, std::string_view key)
+            {
+                expect(token, token_type::string, key);
+                return token.text;
+            }
+
+            static std::string_view number(const token_t& token, std::string_view key)
+            {
+                expect(token, token_type::number, key);
+                return token.text;
+            }
+
+            static void expect(const token_t& token, token_type type, std::string_view key)
+            {
+                if (token.type != type)
+                    unsupported(key);
+            }
+
+            [[noreturn]] static void unsupported(std::string_view key) { throw acmacs::tal::v3::JsonImportError{fmt::format("tree in json format import error: unsupported field: \"{}\"", key)}; }
+        };
+
+    } // namespace tape
 }
 
 // ----------------------------------------------------------------------
@@ -214,6 +498,16 @@ namespace
 void acmacs::tal::v3::json_import(std::string_view filename, Tree& tree)
 {
     tree.data_buffer(acmacs::file::read(filename));
+
+    try {
+        const auto tape = tape::tokenize(tree.data_buffer());
+        tape::builder{tape}.tree(tree);
+        return;
+    }
+    catch (tape::syntax_error&) {
+        // tree is not modified yet, in_json parser below reports error with details
+    }
+
     sink sink{tree};
     try {
         in_json::parse(sink, std::begin(tree.data_buffer()), std::end(tree.data_buffer()));
@@ -10,6 +10,8 @@
 #include "acmacs-tal/dash-bar.hh"
 #include "acmacs-tal/hz-sections.hh"
 #include "acmacs-tal/antigenic-maps.hh"
+#include "acmacs-tal/profile.hh"
+#include "acmacs-tal/parallel.hh"
 
 // ----------------------------------------------------------------------
 
@@ -67,8 +69,37 @@ void acmacs::tal::v3::Layout::reset()
 void acmacs::tal::v3::Layout::prepare()
 {
     for (preparation_stage_t stage = 1; stage <= 3; ++stage) {
-        for (auto& element : elements_)
-            element->prepare(stage);
+        const auto prepare_one = [stage](LayoutElement& element) {
+            const profile::Scope profile_scope{profile::enabled() ? fmt::format("{}{} prepare stage {}", profile::type_name(typeid(element)),
+                                                                                 element.id().empty() ? std::string{} : fmt::format(" \"{}\"", element.id()), stage)
+                                                                   : std::string{}};
+            element.prepare(stage);
+        };
+
+        std::vector<LayoutElement*> concurrent;
+        const auto prepare_concurrent = [&concurrent, prepare_one]() {
+            if (concurrent.size() > 1) {
+                AD_LOG(acmacs::log::tree, "preparing {} layout elements concurrently", concurrent.size());
+                for (auto* element : concurrent)
+                    element->defer_commits();
+                parallel_for(concurrent.size(), [&concurrent, prepare_one](size_t no) { prepare_one(*concurrent[no]); });
+                for (auto* element : concurrent)
+                    element->apply_commits();
+            }
+            else if (concurrent.size() == 1)
+                prepare_one(*concurrent.front());
+            concurrent.clear();
+        };
+
+        for (auto& element : elements_) {
+            if (element->concurrent_prepare(stage))
+                concurrent.push_back(element.get());
+            else {
+                prepare_concurrent();
+                prepare_one(*element);
+            }
+        }
+        prepare_concurrent();
     }
 
 } // acmacs::tal::v3::Layout::prepare
@@ -269,6 +300,68 @@ double acmacs::tal::v3::LayoutElement::pos_y_below(const Node& node, double vert
 
 // ----------------------------------------------------------------------
 
+void acmacs::tal::v3::LayoutElement::require(artifact_t art)
+{
+    auto& tree = tal().tree();
+    if (!tree.artifacts().dirty(art))
+        return;
+
+    AD_LOG(acmacs::log::tree, "{} [id: {}] requires {}", profile::type_name(typeid(*this)), id(), name(art));
+    auto& layout = tal().draw().layout();
+    switch (art) {
+        case artifact_t::structure:
+        case artifact_t::sequences:
+            break; // sources, nothing to compute
+        case artifact_t::node_ids:
+            tree.set_first_last_next_node_id();
+            break;
+        case artifact_t::cumulative_lengths:
+            tree.cumulative_calculate();
+            break;
+        case artifact_t::aa_transitions:
+        case artifact_t::coloring:
+            layout.prepare_element<DrawTree>(1);
+            break;
+        case artifact_t::clade_sections:
+            tree.make_clade_sections();
+            break;
+        case artifact_t::hz_sections:
+            layout.prepare_element<HzSections>(2);
+            break;
+        case artifact_t::vertical_offsets:
+            layout.prepare_element<DrawTree>(3);
+            break;
+        case artifact_t::chart_match:
+            tree.match(tal().chart());
+            break;
+    }
+
+} // acmacs::tal::v3::LayoutElement::require
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::LayoutElement::commit(std::function<void()>&& change)
+{
+    if (defer_commits_)
+        commits_.push_back(std::move(change));
+    else
+        change();
+
+} // acmacs::tal::v3::LayoutElement::commit
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::LayoutElement::apply_commits()
+{
+    defer_commits_ = false;
+    for (auto& change : commits_)
+        change();
+    commits_.clear();
+
+} // acmacs::tal::v3::LayoutElement::apply_commits
+
+// ----------------------------------------------------------------------
+
 void acmacs::tal::v3::Gap::prepare(preparation_stage_t stage)
 {
     if (stage == 1 && prepared_ < stage) {
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <functional>
+
 #include "acmacs-base/log.hh"
 #include "acmacs-draw/surface.hh"
 #include "acmacs-tal/coloring.hh"
 #include "acmacs-tal/parameters.hh"
+#include "acmacs-tal/artifacts.hh"
 
 // ----------------------------------------------------------------------
 
@@ -132,6 +135,13 @@ namespace acmacs::tal::inline v3
         virtual void prepare(preparation_stage_t stage) { prepared_ = stage; }
         virtual void draw(acmacs::surface::Surface& surface) const = 0;
 
+        // Returns true if prepare(stage) only reads the tree and changes the tree and other elements via commit(). Neighbouring
+        // elements returning true are prepared concurrently by Layout::prepare(), then their commits are applied in the layout order.
+        // Called just before prepare(stage), may compute artifacts used by prepare(stage).
+        virtual bool concurrent_prepare(preparation_stage_t /*stage*/) { return false; }
+        void defer_commits() { defer_commits_ = true; }
+        void apply_commits(); // and stop deferring
+
         double pos_y_above(const Node& node, double vertical_step) const;
         double pos_y_below(const Node& node, double vertical_step) const;
 
@@ -144,11 +154,19 @@ namespace acmacs::tal::inline v3
       protected:
         preparation_stage_t prepared_{0};
 
+        // computes artifact (and artifacts it depends on) if it is dirty, by calling the tree or preparing the producing element
+        void require(artifact_t art);
+
+        // change of the tree or another element by prepare(), applied immediately unless deferred by Layout::prepare()
+        void commit(std::function<void()>&& change);
+
       private:
         Tal& tal_;
         double width_to_height_ratio_;
         DrawOutline outline_;
         LayoutElementId id_;
+        bool defer_commits_{false};
+        std::vector<std::function<void()>> commits_;
     };
 
     // ----------------------------------------------------------------------
@@ -0,0 +1,161 @@
+#include <algorithm>
+
+#include "acmacs-virus/virus-name-normalize.hh"
+#include "acmacs-virus/virus-name-v1.hh"
+#include "acmacs-tal/leaf-attributes.hh"
+#include "acmacs-tal/tree.hh"
+#include "acmacs-tal/tree-iterate.hh"
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::StringIds::id_t acmacs::tal::v3::StringIds::id(std::string_view text)
+{
+    if (const auto found = ids_.find(text); found != ids_.end())
+        return found->second;
+    const auto new_id = static_cast<id_t>(strings_.size());
+    ids_.emplace(strings_.emplace_back(text), new_id);
+    return new_id;
+
+} // acmacs::tal::v3::StringIds::id
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::LeafAttributes::LeafAttributes(const Tree& tree)
+{
+    tree::iterate_leaf(tree, [this](const Node& leaf) {
+        leaf.leaf_attributes_row_ = dates_.size();
+        dates_.push_back(date_from(leaf.date));
+        countries_column_.push_back(countries_.id(leaf.country));
+        continents_column_.push_back(continents_.id(leaf.continent));
+        seq_ids_.push_back(*leaf.seq_id);
+        strain_names_.push_back(leaf.strain_name);
+    });
+
+} // acmacs::tal::v3::LeafAttributes::LeafAttributes
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::LeafAttributes::make_virus_name_columns() const
+{
+    std::call_once(virus_name_columns_made_, [this]() {
+        locations_column_.resize(seq_ids_.size(), 0);
+        passages_column_.resize(seq_ids_.size(), 0);
+        for (size_t row = 0; row < seq_ids_.size(); ++row) {
+            if (!strain_names_[row].empty()) {
+                try {
+                    locations_column_[row] = locations_.id(::virus_name::location(acmacs::virus::v2::name_t{strain_names_[row]}));
+                }
+                catch (std::exception&) {
+                    // the row can be a hidden leaf never asked for location, error is reported if location of the leaf is requested
+                    locations_column_[row] = unparsable_location;
+                    location_errors_.emplace(row, std::current_exception());
+                }
+            }
+            const auto name = acmacs::virus::name::parse(seq_ids_[row]);
+            passages_column_[row] = static_cast<uint8_t>((name.passage.is_cell() ? static_cast<uint8_t>(passage_t::cell) : 0) //
+                                                         | (name.passage.is_egg() ? static_cast<uint8_t>(passage_t::egg) : 0) //
+                                                         | (!name.reassortant.empty() ? static_cast<uint8_t>(passage_t::reassortant) : 0));
+        }
+        seq_ids_ = std::vector<std::string>{};
+        strain_names_ = std::vector<std::string_view>{};
+    });
+
+} // acmacs::tal::v3::LeafAttributes::make_virus_name_columns
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::LeafAttributes::date_t acmacs::tal::v3::LeafAttributes::date_from(std::string_view text)
+{
+    if (text.empty())
+        return 0;
+
+    const auto digit = [](char ch) { return ch >= '0' && ch <= '9'; };
+    // code of a two digit field: 0 - absent, value + 1 otherwise, -1 - invalid
+    const auto field = [text, digit](size_t offset, int max_value) -> int {
+        if (text[offset] != '-' || !digit(text[offset + 1]) || !digit(text[offset + 2]))
+            return -1;
+        if (const auto value = (text[offset + 1] - '0') * 10 + (text[offset + 2] - '0'); value <= max_value)
+            return value + 1;
+        else
+            return -1;
+    };
+
+    if (text.size() < 4 || !std::all_of(text.begin(), text.begin() + 4, digit))
+        return unparsable_date;
+    const int year = (text[0] - '0') * 1000 + (text[1] - '0') * 100 + (text[2] - '0') * 10 + (text[3] - '0');
+    int month{0}, day{0};
+    switch (text.size()) {
+        case 4:
+            break;
+        case 7:
+            month = field(4, 12);
+            break;
+        case 10:
+            month = field(4, 12);
+            day = field(7, 31);
+            break;
+        default:
+            return unparsable_date;
+    }
+    if (month < 0 || day < 0)
+        return unparsable_date;
+    return year * 1024 + month * 64 + day;
+
+} // acmacs::tal::v3::LeafAttributes::date_from
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::LeafAttributes::date_t acmacs::tal::v3::LeafAttributes::date(const Node& leaf) const
+{
+    return dates_[leaf.leaf_attributes_row_];
+}
+
+acmacs::tal::v3::LeafAttributes::id_t acmacs::tal::v3::LeafAttributes::country(const Node& leaf) const
+{
+    return countries_column_[leaf.leaf_attributes_row_];
+}
+
+acmacs::tal::v3::LeafAttributes::id_t acmacs::tal::v3::LeafAttributes::continent(const Node& leaf) const
+{
+    return continents_column_[leaf.leaf_attributes_row_];
+}
+
+acmacs::tal::v3::LeafAttributes::id_t acmacs::tal::v3::LeafAttributes::location(const Node& leaf) const
+{
+    make_virus_name_columns();
+    if (const auto id = locations_column_[leaf.leaf_attributes_row_]; id != unparsable_location)
+        return id;
+    std::rethrow_exception(location_errors_.at(leaf.leaf_attributes_row_));
+}
+
+bool acmacs::tal::v3::LeafAttributes::passage(const Node& leaf, passage_t passage) const
+{
+    make_virus_name_columns();
+    return (passages_column_[leaf.leaf_attributes_row_] & static_cast<uint8_t>(passage)) != 0;
+}
+
+// ----------------------------------------------------------------------
+
+date::year_month_day acmacs::tal::v3::LeafAttributes::year_month_day(const Node& leaf) const
+{
+    if (const auto dat = date(leaf); dat > 0) {
+        const auto code = [](int field_code) { return static_cast<unsigned>(field_code > 0 ? field_code - 1 : 0); };
+        return date::year_month_day{date::year{dat / 1024}, date::month{code((dat / 64) % 16)}, date::day{code(dat % 64)}};
+    }
+    else
+        return date::from_string(leaf.date, date::allow_incomplete::yes, date::throw_on_error::yes);
+
+} // acmacs::tal::v3::LeafAttributes::year_month_day
+
+// ----------------------------------------------------------------------
+
+bool acmacs::tal::v3::LeafDateRange::contains(const LeafAttributes& attributes, const Node& leaf) const
+{
+    if (const auto leaf_date = attributes.date(leaf); leaf_date != LeafAttributes::unparsable_date && start_date_ != LeafAttributes::unparsable_date && end_date_ != LeafAttributes::unparsable_date)
+        return leaf_date >= start_date_ && (end_.empty() || leaf_date < end_date_); // empty start is 0
+    else
+        return (start_.empty() || leaf.date >= start_) && (end_.empty() || leaf.date < end_);
+
+} // acmacs::tal::v3::LeafDateRange::contains
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <limits>
+#include <mutex>
+#include <exception>
+#include <cstdint>
+
+#include "acmacs-base/date.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    class Node;
+    class Tree;
+
+    // Strings numbered in order of addition, id 0 is the empty string
+    class StringIds
+    {
+      public:
+        using id_t = uint32_t;
+        constexpr static const id_t not_found{std::numeric_limits<id_t>::max()};
+
+        StringIds() { id(std::string_view{}); }
+        StringIds(const StringIds&) = delete; // ids_ refers to strings_
+        StringIds& operator=(const StringIds&) = delete;
+
+        id_t id(std::string_view text); // adds text if not yet present
+        id_t find(std::string_view text) const { if (const auto found = ids_.find(text); found != ids_.end()) return found->second; else return not_found; }
+        std::string_view operator[](id_t id) const { return strings_[id]; }
+        size_t size() const { return strings_.size(); }
+
+      private:
+        std::deque<std::string> strings_;
+        std::unordered_map<std::string_view, id_t> ids_;
+    };
+
+    // ----------------------------------------------------------------------
+
+    // Leaf data used by selection predicates, coloring and time series, kept in columns indexed by node.leaf_attributes_row_.
+    // Built on demand by Tree::leaf_attributes(), location and passage columns (they require virus name parsing) are made on the first use.
+    class LeafAttributes
+    {
+      public:
+        using id_t = StringIds::id_t;
+        using date_t = int32_t; // see date_from()
+        constexpr static const date_t unparsable_date{-1};
+        enum class passage_t : uint8_t { cell = 1, egg = 2, reassortant = 4 };
+
+        LeafAttributes(const Tree& tree);
+
+        // "YYYY", "YYYY-MM", "YYYY-MM-DD" to integer keeping lexicographic order of the strings (absent month/day is less than 00),
+        // empty date is 0, unparsable_date for other formats
+        static date_t date_from(std::string_view text);
+
+        date_t date(const Node& leaf) const;
+        id_t country(const Node& leaf) const;
+        id_t continent(const Node& leaf) const;
+        id_t location(const Node& leaf) const; // rethrows virus name parsing error for the leaf
+        bool passage(const Node& leaf, passage_t passage) const;
+        // incomplete month/day are 0, as date::from_string(allow_incomplete::yes) returns, throws date::date_parse_error
+        date::year_month_day year_month_day(const Node& leaf) const;
+
+        const StringIds& countries() const { return countries_; }
+        const StringIds& continents() const { return continents_; }
+        const StringIds& locations() const { make_virus_name_columns(); return locations_; }
+
+      private:
+        std::vector<date_t> dates_;
+        std::vector<id_t> countries_column_;
+        std::vector<id_t> continents_column_;
+        StringIds countries_;
+        StringIds continents_;
+
+        mutable std::once_flag virus_name_columns_made_;
+        mutable std::vector<std::string> seq_ids_;          // source for the virus name columns, cleared when they are made
+        mutable std::vector<std::string_view> strain_names_;
+        mutable std::vector<id_t> locations_column_;
+        mutable std::unordered_map<size_t, std::exception_ptr> location_errors_; // rows with unparsable_location
+        mutable std::vector<uint8_t> passages_column_;
+        mutable StringIds locations_;
+        constexpr static const id_t unparsable_location{std::numeric_limits<id_t>::max()};
+
+        void make_virus_name_columns() const;
+    };
+
+    // ----------------------------------------------------------------------
+
+    // [start, end) for selecting leaves by date, empty start or end is not limited.
+    // Same as comparing date strings, strings are compared if one of the dates is not in the YYYY-MM-DD format.
+    class LeafDateRange
+    {
+      public:
+        LeafDateRange() = default;
+        LeafDateRange(std::string_view start, std::string_view end)
+            : start_{start}, end_{end}, start_date_{LeafAttributes::date_from(start)}, end_date_{LeafAttributes::date_from(end)} {}
+
+        bool contains(const LeafAttributes& attributes, const Node& leaf) const;
+
+      private:
+        std::string start_{}, end_{};
+        LeafAttributes::date_t start_date_{0}, end_date_{0};
+    };
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
@@ -17,6 +17,7 @@ namespace acmacs::log::inline v1
     const log_key_t tree{"tree"};
     const log_key_t hz_sections{"hz-sections"};
     const log_key_t time_series{"time-series"};
+    const log_key_t profile{"profile"};
 
 } // namespace acmacs::log::inline v1
 
@@ -1,9 +1,14 @@
 #include <cctype>
 #include <stack>
+#include <deque>
+#include <unordered_map>
 
 #include "acmacs-base/read-file.hh"
 #include "acmacs-base/string.hh"
 #include "acmacs-tal/newick.hh"
+#include "acmacs-tal/export-pipeline.hh"
+#include "acmacs-tal/output-sink.hh"
+#include "acmacs-tal/parallel.hh"
 #include "acmacs-tal/tree.hh"
 
 // https://en.wikipedia.org/wiki/Newick_format
@@ -168,52 +173,138 @@ void acmacs::tal::v3::newick_import(std::string_view filename, Tree& tree)
 
 // ----------------------------------------------------------------------
 
-namespace acmacs::tal::inline v3
+namespace
 {
-    // returns if comma expected to be appended
-    inline bool export_node(fmt::memory_buffer& out, const acmacs::tal::v3::Node& node, const ExportOptions& options, bool prepend_comma)
+    class newick_writer : public acmacs::tal::v3::ExportWriter
     {
-        if (node.hidden)
-            return prepend_comma;
-
-        if (prepend_comma)
-            fmt::format_to_mb(out, ",");
-
-        if (node.is_leaf()) {
-            fmt::format_to_mb(out, "{}", node.seq_id);
-            if (options.add_aa_substitution_labels && !node.aa_transitions_.empty()) {
-                auto label = node.aa_transitions_.display();
-                ::string::replace_in_place(label, ' ', '_');
-                fmt::format_to_mb(out, "+{}", label);
+      public:
+        newick_writer(acmacs::tal::v3::OutputSink& output, const acmacs::tal::v3::ExportOptions& options) : output_{output}, options_{options} {}
+
+        void begin(const acmacs::tal::v3::Tree& tree) override { format_subtrees(tree); }
+        void end(const acmacs::tal::v3::Tree& /*tree*/) override { output_.write(';'); }
+
+        bool enter(const acmacs::tal::v3::Node& node, bool /*last*/) override
+        {
+            if (node.hidden)
+                return false;
+
+            if (!add_comma_.empty()) {
+                if (add_comma_.back())
+                    output_.write(',');
+                add_comma_.back() = true;
+            }
+
+            if (const auto found = formatted_.find(&node); found != std::end(formatted_)) {
+                output_.write(found->second);
+                return false;
+            }
+
+            if (node.is_leaf()) {
+                output_.write(*node.seq_id);
+                if (options_.add_aa_substitution_labels && !node.aa_transitions_.empty()) {
+                    output_.write('+');
+                    aa_transitions_label(node);
+                }
+                edge(node);
+                return false;
             }
+            else {
+                output_.write('(');
+                add_comma_.push_back(false);
+                return true;
+            }
+        }
+
+        void leave(const acmacs::tal::v3::Node& node, bool /*last*/) override
+        {
+            add_comma_.pop_back();
+            output_.write(')');
+            if (options_.add_aa_substitution_labels && !node.aa_transitions_.empty())
+                aa_transitions_label(node);
+            edge(node);
+        }
+
+      private:
+        acmacs::tal::v3::OutputSink& output_;
+        const acmacs::tal::v3::ExportOptions& options_;
+        std::vector<bool> add_comma_; // for each entered intermediate node: if comma is expected before the next sub node
+        std::unordered_map<const acmacs::tal::v3::Node*, std::string> formatted_;
+
+        constexpr static const size_t subtrees_per_thread{8};
+
+        // Large independent subtrees are formatted concurrently (formatting aa transition labels is the most expensive part),
+        // traversal then writes them in order instead of visiting their nodes
+        void format_subtrees(const acmacs::tal::v3::Tree& tree)
+        {
+            const auto threads = acmacs::tal::v3::number_of_threads(options_.export_threads);
+            if (threads < 2)
+                return;
+            const auto subtrees = split(tree, threads * subtrees_per_thread);
+            if (subtrees.size() < 2)
+                return;
+            std::vector<std::string> formatted(subtrees.size());
+            acmacs::tal::v3::parallel_for(
+                subtrees.size(),
+                [this, &subtrees, &formatted](size_t index) {
+                    acmacs::tal::v3::StringSink output{formatted[index]};
+                    newick_writer writer{output, options_};
+                    acmacs::tal::v3::export_traverse_subtree(*subtrees[index], {&writer});
+                    output.close();
+                },
+                threads);
+            for (size_t index = 0; index < subtrees.size(); ++index)
+                formatted_.emplace(subtrees[index], std::move(formatted[index]));
         }
-        else {
-            fmt::format_to_mb(out, "(");
-            bool add_comma = false;
-            for (const auto& sub_node : node.subtree)
-                add_comma = export_node(out, sub_node, options, add_comma);
-            fmt::format_to_mb(out, ")");
-            if (options.add_aa_substitution_labels && !node.aa_transitions_.empty()) {
-                auto label = node.aa_transitions_.display();
-                ::string::replace_in_place(label, ' ', '_');
-                fmt::format_to_mb(out, "{}", label);
+
+        // returns disjoint intermediate shown subtrees, breadth first expansion from the root until there are enough of them
+        static std::vector<const acmacs::tal::v3::Node*> split(const acmacs::tal::v3::Node& root, size_t wanted)
+        {
+            std::deque<const acmacs::tal::v3::Node*> frontier{&root};
+            while (!frontier.empty() && frontier.size() < wanted) {
+                const auto* node = frontier.front();
+                frontier.pop_front();
+                for (const auto& sub_node : node->subtree) {
+                    if (!sub_node.is_leaf() && !sub_node.hidden)
+                        frontier.push_back(&sub_node);
+                }
             }
+            return {std::begin(frontier), std::end(frontier)};
         }
-        if (!node.edge_length.is_zero())
-            fmt::format_to_mb(out, ":{}", node.edge_length.as_string());
-        return true;
-    }
 
-} // namespace acmacs::tal::inline v3
+        void aa_transitions_label(const acmacs::tal::v3::Node& node)
+        {
+            auto label = node.aa_transitions_.display();
+            ::string::replace_in_place(label, ' ', '_');
+            output_.write(label);
+        }
+
+        void edge(const acmacs::tal::v3::Node& node)
+        {
+            if (!node.edge_length.is_zero())
+                output_.format(":{}", node.edge_length);
+        }
+    };
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+std::unique_ptr<acmacs::tal::v3::ExportWriter> acmacs::tal::v3::newick_export_writer(OutputSink& output, const ExportOptions& options)
+{
+    return std::make_unique<newick_writer>(output, options);
+
+} // acmacs::tal::v3::newick_export_writer
 
 // ----------------------------------------------------------------------
 
 std::string acmacs::tal::v3::newick_export(const Tree& tree, const ExportOptions& options)
 {
-    fmt::memory_buffer out;
-    export_node(out, tree, options, false);
-    fmt::format_to_mb(out, ";");
-    return fmt::to_string(out);
+    std::string result;
+    StringSink output{result};
+    newick_writer writer{output, options};
+    export_traverse(tree, {&writer});
+    output.close();
+    return result;
 
 } // acmacs::tal::v3::newick_export
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string_view>
+#include <memory>
 #include "acmacs-tal/import-export.hh"
 
 // ----------------------------------------------------------------------
@@ -8,12 +9,15 @@
 namespace acmacs::tal::inline v3
 {
     class Tree;
+    class OutputSink;
+    class ExportWriter;
 
     class NewickImportError : public std::runtime_error { public: using std::runtime_error::runtime_error; };
     class NewickExportError : public std::runtime_error { public: using std::runtime_error::runtime_error; };
 
     void newick_import(std::string_view filename, Tree& tree);
     std::string newick_export(const Tree& tree, const ExportOptions& options);
+    std::unique_ptr<ExportWriter> newick_export_writer(OutputSink& output, const ExportOptions& options); // for export_traverse()
 }
 
 // ----------------------------------------------------------------------
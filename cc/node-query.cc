@@ -0,0 +1,310 @@
+#include <optional>
+
+#include "acmacs-tal/log.hh"
+#include "acmacs-tal/node-query.hh"
+#include "acmacs-tal/tree-iterate.hh"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    using namespace acmacs::tal;
+
+    // node fields go first, then leaf attribute columns, sequences, seq_id patterns last
+    constexpr size_t cost(NodeQuery::kind_t kind)
+    {
+        switch (kind) {
+            case NodeQuery::kind_t::all:
+            case NodeQuery::kind_t::all_and_intermediate:
+            case NodeQuery::kind_t::cumulative_more_than:
+            case NodeQuery::kind_t::edge_more_than:
+            case NodeQuery::kind_t::edge_more_than_mean_edge_of:
+            case NodeQuery::kind_t::top_cumulative_gap:
+            case NodeQuery::kind_t::matches_chart_antigens:
+            case NodeQuery::kind_t::matches_chart_sera:
+            case NodeQuery::kind_t::vaccine:
+                return 0;
+            case NodeQuery::kind_t::country:
+            case NodeQuery::kind_t::date:
+            case NodeQuery::kind_t::location:
+                return 1;
+            case NodeQuery::kind_t::aa:
+            case NodeQuery::kind_t::nuc:
+                return 2;
+            case NodeQuery::kind_t::seq_id:
+                return 3;
+        }
+        return 0;
+    }
+
+    NodeBitset vaccine_nodes(Tree& tree, const NodeIndex& node_index, const LeafAttributes& attributes, NodeQuery::passage_t passage, const std::vector<std::string>& names)
+    {
+        // all vaccine names are looked for in a single pass
+        std::vector<std::string> patterns(names.size());
+        std::transform(std::begin(names), std::end(names), std::begin(patterns), [](const auto& name) { return *acmacs::seqdb::make_seq_id(name); });
+        const auto matcher = seq_id_matcher(patterns);
+        NodeBitset selected{node_index};
+        tree::iterate_leaf(tree, [&selected, &matcher](const Node& node) {
+            if (!node.hidden && matcher->matches_any(*node.seq_id))
+                selected.insert(node);
+        });
+
+        const auto exclude = [&selected, &attributes](LeafAttributes::passage_t required) {
+            for (const auto* node : selected.nodes()) {
+                if (!attributes.passage(*node, required))
+                    selected.erase(*node);
+            }
+        };
+        switch (passage) {
+            case NodeQuery::passage_t::cell:
+                exclude(LeafAttributes::passage_t::cell);
+                break;
+            case NodeQuery::passage_t::egg:
+                exclude(LeafAttributes::passage_t::egg);
+                break;
+            case NodeQuery::passage_t::reassortant:
+                exclude(LeafAttributes::passage_t::reassortant);
+                break;
+            case NodeQuery::passage_t::any:
+                break;
+        }
+        return selected;
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::NodeQuery::criterium_t& acmacs::tal::v3::NodeQuery::add(kind_t kind)
+{
+    // keep criteria sorted by cost, criteria of the same cost are in the settings order
+    const auto pos = std::upper_bound(std::begin(criteria_), std::end(criteria_), cost(kind), [](size_t cst, const criterium_t& criterium) { return cst < cost(criterium.kind); });
+    return *criteria_.insert(pos, criterium_t{.kind = kind, .order = criteria_.size()});
+
+} // acmacs::tal::v3::NodeQuery::add
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::NodeQuery::all()
+{
+    add(kind_t::all);
+}
+
+void acmacs::tal::v3::NodeQuery::all_and_intermediate()
+{
+    add(kind_t::all_and_intermediate);
+}
+
+void acmacs::tal::v3::NodeQuery::aa(const acmacs::seqdb::amino_acid_at_pos1_eq_list_t& aa_at_pos1)
+{
+    add(kind_t::aa).aa_at_pos1 = aa_at_pos1;
+}
+
+void acmacs::tal::v3::NodeQuery::nuc(const acmacs::seqdb::nucleotide_at_pos1_eq_list_t& nuc_at_pos1)
+{
+    add(kind_t::nuc).nuc_at_pos1 = nuc_at_pos1;
+}
+
+void acmacs::tal::v3::NodeQuery::country(std::string_view country)
+{
+    add(kind_t::country).text.assign(country);
+}
+
+void acmacs::tal::v3::NodeQuery::cumulative_more_than(double cumulative_min)
+{
+    add(kind_t::cumulative_more_than).number = cumulative_min;
+}
+
+void acmacs::tal::v3::NodeQuery::date(std::string_view start, std::string_view end)
+{
+    add(kind_t::date).date_range = LeafDateRange{start, end};
+}
+
+void acmacs::tal::v3::NodeQuery::edge_more_than(double edge_min)
+{
+    add(kind_t::edge_more_than).number = edge_min;
+}
+
+void acmacs::tal::v3::NodeQuery::edge_more_than_mean_edge_of(double fraction_or_number)
+{
+    add(kind_t::edge_more_than_mean_edge_of).number = fraction_or_number;
+}
+
+void acmacs::tal::v3::NodeQuery::location(std::string_view location)
+{
+    add(kind_t::location).text.assign(location);
+}
+
+void acmacs::tal::v3::NodeQuery::matches_chart_antigens()
+{
+    add(kind_t::matches_chart_antigens);
+}
+
+void acmacs::tal::v3::NodeQuery::matches_chart_sera(Tree::serum_match_t match_type)
+{
+    add(kind_t::matches_chart_sera).serum_match = match_type;
+}
+
+void acmacs::tal::v3::NodeQuery::seq_id(std::string_view regexp)
+{
+    add(kind_t::seq_id).seq_id_matcher = acmacs::tal::v3::seq_id_matcher({std::string{regexp}});
+}
+
+void acmacs::tal::v3::NodeQuery::top_cumulative_gap(double top_gap_rel)
+{
+    add(kind_t::top_cumulative_gap).number = top_gap_rel;
+}
+
+void acmacs::tal::v3::NodeQuery::vaccine(std::string_view vaccine_type, passage_t passage)
+{
+    auto& criterium = add(kind_t::vaccine);
+    criterium.text.assign(vaccine_type);
+    criterium.passage = passage;
+}
+
+// ----------------------------------------------------------------------
+
+bool acmacs::tal::v3::NodeQuery::needs_chart() const
+{
+    return std::any_of(std::begin(criteria_), std::end(criteria_), [](const auto& criterium) { return criterium.kind == kind_t::matches_chart_antigens || criterium.kind == kind_t::matches_chart_sera; });
+
+} // acmacs::tal::v3::NodeQuery::needs_chart
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::NodeSet acmacs::tal::v3::NodeQuery::select(Tree& tree, const vaccine_names_t& vaccine_names) const
+{
+    NodeSet selected;
+    if (criteria_.empty())
+        return selected;
+
+    // thresholds and vaccine sets depend on the current state of the tree, they are not kept in the compiled query
+    struct prepared_t
+    {
+        bool applied{true};
+        EdgeLength threshold{};
+        LeafAttributes::id_t id{StringIds::not_found}; // country, location
+        std::optional<NodeBitset> members{};
+    };
+
+    const auto attributes = tree.leaf_attributes();
+    std::optional<NodeIndex> node_index;
+    std::vector<prepared_t> prepared(criteria_.size());
+    size_t first{0}; // the first criterium in the settings
+    for (size_t no = 0; no < criteria_.size(); ++no) {
+        const auto& criterium = criteria_[no];
+        auto& prep = prepared[no];
+        if (criterium.order == 0)
+            first = no;
+        switch (criterium.kind) {
+            case kind_t::cumulative_more_than:
+                tree.cumulative_calculate();
+                prep.threshold = EdgeLength{criterium.number};
+                break;
+            case kind_t::edge_more_than:
+                prep.threshold = EdgeLength{criterium.number};
+                break;
+            case kind_t::edge_more_than_mean_edge_of:
+                prep.threshold = EdgeLength{tree.mean_edge_of(criterium.number)};
+                break;
+            case kind_t::top_cumulative_gap:
+                if (const auto cut_off = tree.top_cumulative_gap_cut_off(criterium.number); cut_off.has_value()) {
+                    tree.cumulative_calculate();
+                    prep.threshold = EdgeLength{*cut_off};
+                }
+                else if (criterium.order == 0)
+                    return selected; // nothing selected in the first place
+                else
+                    prep.applied = false;
+                break;
+            case kind_t::vaccine:
+                if (!node_index.has_value())
+                    node_index.emplace(tree);
+                prep.members = vaccine_nodes(tree, *node_index, *attributes, criterium.passage, vaccine_names(criterium.text));
+                break;
+            case kind_t::country:
+                prep.id = attributes->countries().find(criterium.text);
+                break;
+            case kind_t::location:
+                prep.id = attributes->locations().find(criterium.text);
+                break;
+            case kind_t::all:
+            case kind_t::all_and_intermediate:
+            case kind_t::aa:
+            case kind_t::nuc:
+            case kind_t::date:
+            case kind_t::matches_chart_antigens:
+            case kind_t::matches_chart_sera:
+            case kind_t::seq_id:
+                break;
+        }
+    }
+
+    const auto matches = [this, &prepared, &attributes](const Node& node, size_t no) -> bool {
+        const auto& criterium = criteria_[no];
+        const auto& prep = prepared[no];
+        switch (criterium.kind) {
+            case kind_t::all:
+                return node.is_leaf() && !node.hidden;
+            case kind_t::all_and_intermediate:
+                return !node.hidden;
+            case kind_t::aa:
+                return node.is_leaf() && !node.hidden && acmacs::seqdb::matches(node.aa_sequence, criterium.aa_at_pos1);
+            case kind_t::nuc:
+                return node.is_leaf() && !node.hidden && acmacs::seqdb::matches(node.nuc_sequence, criterium.nuc_at_pos1);
+            case kind_t::country:
+                return node.is_leaf() && !node.hidden && attributes->country(node) == prep.id;
+            case kind_t::cumulative_more_than:
+            case kind_t::top_cumulative_gap:
+                return !prep.applied || (!node.hidden && node.cumulative_edge_length >= prep.threshold);
+            case kind_t::date:
+                return node.is_leaf() && !node.hidden && criterium.date_range.contains(*attributes, node);
+            case kind_t::edge_more_than:
+            case kind_t::edge_more_than_mean_edge_of:
+                return !node.hidden && node.edge_length >= prep.threshold;
+            case kind_t::location:
+                return node.is_leaf() && !node.hidden && !node.strain_name.empty() && attributes->location(node) == prep.id;
+            case kind_t::matches_chart_antigens:
+                return node.is_leaf() && node.antigen_index_in_chart_.has_value();
+            case kind_t::matches_chart_sera:
+                return Tree::matches_chart_serum(node, criterium.serum_match);
+            case kind_t::seq_id:
+                return node.is_leaf() && !node.hidden && criterium.seq_id_matcher->matches_any(*node.seq_id);
+            case kind_t::vaccine:
+                return prep.members->contains(node);
+        }
+        return false;
+    };
+
+    const auto matches_all = [&matches, count = criteria_.size()](const Node& node) {
+        for (size_t no = 0; no < count; ++no) {
+            if (!matches(node, no))
+                return false;
+        }
+        return true;
+    };
+
+    if (criteria_[first].kind == kind_t::top_cumulative_gap || criteria_[first].kind == kind_t::cumulative_more_than) {
+        // as in Tree::select_by_top_cumulative_gap and Tree::select_if_cumulative_more_than (Descent::no),
+        // subtree of a node above the threshold is not looked at
+        const auto add = [&](Node& node) {
+            if (!matches(node, first))
+                return true;
+            if (matches_all(node))
+                selected.push_back(&node);
+            return false;
+        };
+        tree::iterate_leaf_pre_stop(tree, add, add);
+    }
+    else {
+        const auto add = [&](Node& node) {
+            if (matches_all(node))
+                selected.push_back(&node);
+        };
+        tree::iterate_leaf_pre(tree, add, add);
+    }
+    return selected;
+
+} // acmacs::tal::v3::NodeQuery::select
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "acmacs-tal/tree.hh"
+#include "acmacs-tal/seq-id-matcher.hh"
+#include "acmacs-tal/leaf-attributes.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    // Node selection criteria ("select" in settings) compiled once and evaluated in a single tree pass.
+    // Criteria are combined with "and", cheaper ones are checked first. Result is in tree order.
+    class NodeQuery
+    {
+      public:
+        enum class passage_t { any, cell, egg, reassortant };
+        enum class kind_t {
+            all,
+            all_and_intermediate,
+            aa,
+            nuc,
+            country,
+            cumulative_more_than,
+            date,
+            edge_more_than,
+            edge_more_than_mean_edge_of,
+            location,
+            matches_chart_antigens,
+            matches_chart_sera,
+            seq_id,
+            top_cumulative_gap,
+            vaccine
+        };
+        using vaccine_names_t = std::function<std::vector<std::string>(std::string_view vaccine_type)>;
+
+        void all();
+        void all_and_intermediate();
+        void aa(const acmacs::seqdb::amino_acid_at_pos1_eq_list_t& aa_at_pos1);
+        void nuc(const acmacs::seqdb::nucleotide_at_pos1_eq_list_t& nuc_at_pos1);
+        void country(std::string_view country);
+        void cumulative_more_than(double cumulative_min);
+        void date(std::string_view start, std::string_view end);
+        void edge_more_than(double edge_min);
+        void edge_more_than_mean_edge_of(double fraction_or_number);
+        void location(std::string_view location);
+        void matches_chart_antigens();
+        void matches_chart_sera(Tree::serum_match_t match_type);
+        void seq_id(std::string_view regexp);
+        void top_cumulative_gap(double top_gap_rel);
+        void vaccine(std::string_view vaccine_type, passage_t passage);
+
+        bool empty() const { return criteria_.empty(); }
+        bool needs_chart() const; // tree must be matched against chart before select()
+
+        // vaccine_names is called for each "vaccine" criterium to get names of vaccines of the current virus type/lineage
+        NodeSet select(Tree& tree, const vaccine_names_t& vaccine_names) const;
+
+      private:
+        struct criterium_t
+        {
+            kind_t kind;
+            size_t order;             // in the settings, the first one defines how tree is traversed
+            double number{0.0};       // threshold, fraction, top_gap_rel
+            std::string text{};       // country, location, vaccine type
+            LeafDateRange date_range{};
+            std::shared_ptr<const SeqIdMatcher> seq_id_matcher{};
+            acmacs::seqdb::amino_acid_at_pos1_eq_list_t aa_at_pos1{};
+            acmacs::seqdb::nucleotide_at_pos1_eq_list_t nuc_at_pos1{};
+            Tree::serum_match_t serum_match{Tree::serum_match_t::name};
+            passage_t passage{passage_t::any};
+        };
+
+        std::vector<criterium_t> criteria_; // sorted by cost
+
+        criterium_t& add(kind_t kind);
+    };
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,287 @@
+#include <cerrno>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <lzma.h>
+
+#include "acmacs-tal/log.hh"
+#include "acmacs-tal/output-sink.hh"
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::FileSink::FileSink(std::string_view filename)
+    : filename_{filename}
+{
+    if (filename_ == "-" || filename_ == "/") {
+        file_ = stdout;
+    }
+    else {
+        file_ = std::fopen(filename_.c_str(), "wb");
+        if (!file_)
+            throw OutputError{fmt::format("cannot open {} for writing: {}", filename_, std::strerror(errno))};
+    }
+
+} // acmacs::tal::v3::FileSink::FileSink
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::FileSink::~FileSink()
+{
+    if (file_ && file_ != stdout) {
+        // not closed: producing data failed, incomplete file is removed
+        std::fclose(file_);
+        std::remove(filename_.c_str());
+    }
+
+} // acmacs::tal::v3::FileSink::~FileSink
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::FileSink::consume(std::string_view data)
+{
+    if (std::fwrite(data.data(), 1, data.size(), file_) != data.size())
+        throw OutputError{fmt::format("cannot write to {}: {}", filename_, std::strerror(errno))};
+
+} // acmacs::tal::v3::FileSink::consume
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::FileSink::close()
+{
+    OutputSink::close();
+    if (file_) {
+        if (file_ == stdout) {
+            std::fflush(file_);
+        }
+        else {
+            const auto result = std::fclose(file_);
+            file_ = nullptr;
+            if (result != 0)
+                throw OutputError{fmt::format("cannot close {}: {}", filename_, std::strerror(errno))};
+        }
+    }
+
+} // acmacs::tal::v3::FileSink::close
+
+// ----------------------------------------------------------------------
+
+struct acmacs::tal::v3::XzSink::impl
+{
+    lzma_stream stream = LZMA_STREAM_INIT;
+    std::array<uint8_t, 1024 * 1024> out;
+
+    // passes all compressed data produced so far to the target
+    void code(OutputSink& target, lzma_action action)
+    {
+        for (;;) {
+            stream.next_out = out.data();
+            stream.avail_out = out.size();
+            const auto ret = lzma_code(&stream, action);
+            if (const auto produced = out.size() - stream.avail_out; produced)
+                target.write(std::string_view{reinterpret_cast<const char*>(out.data()), produced});
+            if (ret == LZMA_STREAM_END)
+                return;
+            if (ret != LZMA_OK)
+                throw OutputError{fmt::format("lzma_code failed: {}", static_cast<int>(ret))};
+            if (action == LZMA_RUN && stream.avail_in == 0)
+                return;
+        }
+    }
+};
+
+// ----------------------------------------------------------------------
+
+uint64_t acmacs::tal::v3::XzSink::mt_memory_limit()
+{
+    constexpr const uint64_t physmem_unknown_limit{2UL * 1024 * 1024 * 1024};
+    if (const auto physmem = lzma_physmem(); physmem > 0)
+        return std::max(physmem / 4, physmem_unknown_limit / 2);
+    return physmem_unknown_limit;
+
+} // acmacs::tal::v3::XzSink::mt_memory_limit
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::XzSink::XzSink(std::unique_ptr<OutputSink> target, unsigned preset, size_t threads)
+    : target_{std::move(target)}, impl_{std::make_unique<impl>()}
+{
+    if (threads == 0)
+        threads = std::max(lzma_cputhreads(), 1U);
+
+    lzma_mt options{}; // reserved fields must be zero
+    options.block_size = mt_block_size; // default (3 * dictionary size = 192MiB for preset 9) gives too few blocks for our exports
+    options.timeout = 0;    // lzma_code blocks until output is available
+    options.preset = preset;
+    options.filters = nullptr;
+    options.check = LZMA_CHECK_CRC64;
+    if (threads > 1) {
+        // memory usage grows linearly with threads, reduce them to fit into the limit (lzma_stream_encoder_mt_memusage returns UINT64_MAX for invalid options, lzma_stream_encoder_mt reports it)
+        const auto limit = mt_memory_limit();
+        for (options.threads = static_cast<uint32_t>(std::min(threads, size_t{UINT32_MAX})); options.threads > 1 && lzma_stream_encoder_mt_memusage(&options) > limit; --options.threads)
+            ;
+        if (options.threads < threads)
+            AD_WARNING("xz compression: {} threads reduced to {} to keep memory usage within {}MiB", threads, options.threads, limit / (1024 * 1024));
+        threads = options.threads;
+    }
+
+    if (threads == 1) {
+        if (const auto ret = lzma_easy_encoder(&impl_->stream, preset, LZMA_CHECK_CRC64); ret != LZMA_OK)
+            throw OutputError{fmt::format("lzma_easy_encoder failed: {}", static_cast<int>(ret))};
+    }
+    else {
+        if (const auto ret = lzma_stream_encoder_mt(&impl_->stream, &options); ret != LZMA_OK)
+            throw OutputError{fmt::format("lzma_stream_encoder_mt failed: {} (threads: {})", static_cast<int>(ret), threads)};
+    }
+
+} // acmacs::tal::v3::XzSink::XzSink
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::XzSink::~XzSink()
+{
+    lzma_end(&impl_->stream);
+
+} // acmacs::tal::v3::XzSink::~XzSink
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::XzSink::consume(std::string_view data)
+{
+    impl_->stream.next_in = reinterpret_cast<const uint8_t*>(data.data());
+    impl_->stream.avail_in = data.size();
+    impl_->code(*target_, LZMA_RUN);
+
+} // acmacs::tal::v3::XzSink::consume
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::XzSink::close()
+{
+    OutputSink::close();
+    impl_->stream.next_in = nullptr;
+    impl_->stream.avail_in = 0;
+    impl_->code(*target_, LZMA_FINISH);
+    target_->close();
+
+} // acmacs::tal::v3::XzSink::close
+
+// ----------------------------------------------------------------------
+
+struct acmacs::tal::v3::ThreadedSink::impl
+{
+    impl(std::unique_ptr<OutputSink> a_target) : target{std::move(a_target)}, thread{[this]() { run(); }} {}
+
+    std::unique_ptr<OutputSink> target;
+    std::mutex access;
+    std::condition_variable changed;
+    std::deque<std::string> pending;
+    bool done{false};
+    bool aborted{false}; // destroyed without close(), pending data is dropped, target is not closed
+    std::exception_ptr error;
+    std::thread thread; // must be the last member, it is started in the constructor
+
+    void run()
+    {
+        try {
+            for (;;) {
+                std::string chunk;
+                {
+                    std::unique_lock lock{access};
+                    changed.wait(lock, [this]() { return !pending.empty() || done; });
+                    if (aborted) {
+                        pending.clear();
+                        return;
+                    }
+                    if (pending.empty())
+                        break;
+                    chunk = std::move(pending.front());
+                    pending.pop_front();
+                }
+                changed.notify_all();
+                target->write(chunk);
+            }
+            target->close();
+        }
+        catch (...) {
+            std::unique_lock lock{access};
+            error = std::current_exception();
+            pending.clear();
+        }
+        changed.notify_all();
+    }
+
+    void finish(bool abort = false)
+    {
+        {
+            std::unique_lock lock{access};
+            done = true;
+            aborted = abort;
+        }
+        changed.notify_all();
+        if (thread.joinable())
+            thread.join();
+    }
+};
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::ThreadedSink::ThreadedSink(std::unique_ptr<OutputSink> target)
+    : impl_{std::make_unique<impl>(std::move(target))}
+{
+} // acmacs::tal::v3::ThreadedSink::ThreadedSink
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::ThreadedSink::~ThreadedSink()
+{
+    // after close() it just joins finished thread, otherwise (e.g. export failed) target is destroyed without finishing the output
+    impl_->finish(true);
+
+} // acmacs::tal::v3::ThreadedSink::~ThreadedSink
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::ThreadedSink::consume(std::string_view data)
+{
+    {
+        std::unique_lock lock{impl_->access};
+        impl_->changed.wait(lock, [this]() { return impl_->pending.size() < max_pending || impl_->error; });
+        if (impl_->error)
+            return; // reported by close()
+        impl_->pending.emplace_back(data);
+    }
+    impl_->changed.notify_all();
+
+} // acmacs::tal::v3::ThreadedSink::consume
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::ThreadedSink::close()
+{
+    OutputSink::close();
+    impl_->finish();
+    if (impl_->error)
+        std::rethrow_exception(impl_->error);
+
+} // acmacs::tal::v3::ThreadedSink::close
+
+// ----------------------------------------------------------------------
+
+std::unique_ptr<acmacs::tal::v3::OutputSink> acmacs::tal::v3::make_output_sink(std::string_view filename, compress_output compress, size_t compression_threads)
+{
+    auto file = std::make_unique<FileSink>(filename);
+    switch (compress) {
+        case compress_output::no:
+            return file;
+        case compress_output::xz:
+            return std::make_unique<XzSink>(std::move(file), XzSink::default_preset, compression_threads);
+    }
+    return file; // g++9 wants this
+
+} // acmacs::tal::v3::make_output_sink
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#include "acmacs-base/fmt.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    class OutputError : public std::runtime_error { public: using std::runtime_error::runtime_error; };
+
+    // Buffered output, data is passed to consume() in chunks of about flush_threshold bytes
+    class OutputSink
+    {
+      public:
+        constexpr static const size_t flush_threshold{1024 * 1024};
+
+        OutputSink() = default;
+        OutputSink(const OutputSink&) = delete;
+        OutputSink& operator=(const OutputSink&) = delete;
+        virtual ~OutputSink() = default;
+
+        void write(std::string_view data)
+        {
+            buffer_.append(data.data(), data.data() + data.size());
+            if (buffer_.size() >= flush_threshold)
+                flush();
+        }
+
+        void write(char data)
+        {
+            buffer_.push_back(data);
+            if (buffer_.size() >= flush_threshold)
+                flush();
+        }
+
+        template <typename... Args> void format(fmt::format_string<Args...> format, Args&&... args)
+        {
+            fmt::format_to(std::back_inserter(buffer_), format, std::forward<Args>(args)...);
+            if (buffer_.size() >= flush_threshold)
+                flush();
+        }
+
+        void flush()
+        {
+            if (buffer_.size() > 0) {
+                consume(std::string_view{buffer_.data(), buffer_.size()});
+                buffer_.clear();
+            }
+        }
+
+        // flushes buffer and finishes output, must be called before destruction, otherwise output is incomplete
+        // (FileSink removes it then, XzSink does not finish the stream)
+        virtual void close() { flush(); }
+
+      protected:
+        virtual void consume(std::string_view data) = 0;
+
+      private:
+        fmt::memory_buffer buffer_;
+    };
+
+    // ----------------------------------------------------------------------
+
+    class StringSink : public OutputSink
+    {
+      public:
+        StringSink(std::string& target) : target_{target} {}
+
+      protected:
+        void consume(std::string_view data) override { target_.append(data); }
+
+      private:
+        std::string& target_;
+    };
+
+    // ----------------------------------------------------------------------
+
+    class FileSink : public OutputSink
+    {
+      public:
+        FileSink(std::string_view filename); // "-" for stdout
+        ~FileSink() override;                 // removes the file if it was not closed
+
+        void close() override;
+
+      protected:
+        void consume(std::string_view data) override;
+
+      private:
+        std::string filename_;
+        std::FILE* file_{nullptr};
+    };
+
+    // ----------------------------------------------------------------------
+
+    // xz (lzma) compression of the passed data, compressed data is written into target
+    // threads > 1: multithreaded block encoder, input is split into independently compressed blocks, output is a standard .xz stream
+    // threads == 0: number of hardware threads
+    // each thread needs ~0.7GiB at preset 9, threads are reduced to keep the encoder within mt_memory_limit() (1 thread: single threaded encoder)
+    class XzSink : public OutputSink
+    {
+      public:
+        constexpr static const unsigned default_preset{9}; // the same as acmacs::file::write
+        constexpr static const size_t mt_block_size{32 * 1024 * 1024};
+        static uint64_t mt_memory_limit(); // quarter of the physical memory
+
+        XzSink(std::unique_ptr<OutputSink> target, unsigned preset = default_preset, size_t threads = 1);
+        ~XzSink() override;
+
+        void close() override;
+
+      protected:
+        void consume(std::string_view data) override;
+
+      private:
+        struct impl;
+        std::unique_ptr<OutputSink> target_;
+        std::unique_ptr<impl> impl_;
+    };
+
+    // ----------------------------------------------------------------------
+
+    // data is written into target (and compressed if target is XzSink) by a separate thread,
+    // at most max_pending chunks are queued, producer waits if writing is slower
+    class ThreadedSink : public OutputSink
+    {
+      public:
+        constexpr static const size_t max_pending{4};
+
+        ThreadedSink(std::unique_ptr<OutputSink> target);
+        ~ThreadedSink() override;
+
+        void close() override; // rethrows exception thrown by the writing thread
+
+      protected:
+        void consume(std::string_view data) override;
+
+      private:
+        struct impl;
+        std::unique_ptr<impl> impl_;
+    };
+
+    // ----------------------------------------------------------------------
+
+    enum class compress_output { no, xz };
+
+    // "-" and "/" for stdout
+    // compression_threads: see XzSink
+    std::unique_ptr<OutputSink> make_output_sink(std::string_view filename, compress_output compress, size_t compression_threads = 1);
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
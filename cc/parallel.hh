@@ -0,0 +1,71 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <vector>
+#include <algorithm>
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    // 0 - number of hardware threads
+    inline size_t number_of_threads(size_t requested = 0)
+    {
+        if (requested == 0)
+            requested = std::thread::hardware_concurrency();
+        return std::max(requested, size_t{1});
+    }
+
+    // calls func(index) for every index in [0, count) using up to threads threads (0 - number of hardware threads),
+    // indexes are taken by threads one by one, order of calls is not defined
+    // the first exception thrown by func is rethrown after all threads finished
+    template <typename F> void parallel_for(size_t count, F&& func, size_t threads = 0)
+    {
+        threads = std::min(number_of_threads(threads), count);
+        if (threads < 2) {
+            for (size_t index = 0; index < count; ++index)
+                func(index);
+            return;
+        }
+
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+        std::mutex error_access;
+        const auto worker = [&]() {
+            try {
+                for (auto index = next++; index < count; index = next++)
+                    func(index);
+            }
+            catch (...) {
+                std::unique_lock lock{error_access};
+                if (!error)
+                    error = std::current_exception();
+                next = count;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t thread_no = 1; thread_no < threads; ++thread_no)
+            workers.emplace_back(worker);
+        worker();
+        for (auto& thread : workers)
+            thread.join();
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // calls func(first, last) for consecutive chunks of [0, count) having chunk_size indexes (the last one may be shorter),
+    // chunk number is first / chunk_size
+    template <typename F> void parallel_for_chunks(size_t count, size_t chunk_size, F&& func, size_t threads = 0)
+    {
+        const auto chunks = (count + chunk_size - 1) / chunk_size;
+        parallel_for(
+            chunks, [count, chunk_size, &func](size_t chunk_no) { func(chunk_no * chunk_size, std::min(count, (chunk_no + 1) * chunk_size)); }, threads);
+    }
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
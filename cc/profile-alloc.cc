@@ -0,0 +1,40 @@
+#include <cstdlib>
+#include <new>
+
+#include "acmacs-tal/profile.hh"
+
+// ----------------------------------------------------------------------
+
+// Linked into the tal program only (see Makefile), libtal must not replace operator new of programs using it.
+// Allocations are counted only while profiling is enabled, otherwise it's plain malloc.
+// Sized, array and nothrow forms of libstdc++ call this one.
+
+void* operator new(std::size_t size)
+{
+    if (acmacs::tal::v3::profile::enabled()) {
+        acmacs::tal::v3::profile::detail::allocations.fetch_add(1, std::memory_order_relaxed);
+        acmacs::tal::v3::profile::detail::allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    if (size == 0)
+        size = 1;
+    for (;;) {
+        if (void* ptr = std::malloc(size); ptr)
+            return ptr;
+        if (const auto handler = std::get_new_handler(); handler)
+            handler();
+        else
+            throw std::bad_alloc{};
+    }
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t /*size*/) noexcept
+{
+    std::free(ptr);
+}
+
+// ----------------------------------------------------------------------
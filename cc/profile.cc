@@ -0,0 +1,193 @@
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <cxxabi.h>
+
+#include "acmacs-base/fmt.hh"
+#include "acmacs-tal/profile.hh"
+
+// ----------------------------------------------------------------------
+
+std::atomic<bool> acmacs::tal::v3::profile::detail::enabled{false};
+std::atomic<size_t> acmacs::tal::v3::profile::detail::allocations{0};
+std::atomic<size_t> acmacs::tal::v3::profile::detail::allocated_bytes{0};
+std::atomic<size_t> acmacs::tal::v3::profile::detail::tree_traversals{0};
+
+namespace
+{
+    using namespace acmacs::tal::v3::profile;
+
+    struct entry_t
+    {
+        std::string name;
+        size_t calls{0};
+        std::chrono::steady_clock::duration total{0};
+        std::chrono::steady_clock::duration self{0};
+        size_t allocations{0};
+        size_t allocated_bytes{0};
+        size_t tree_traversals{0};
+    };
+
+    struct entries_t
+    {
+        std::mutex access;
+        std::vector<entry_t> entries; // in the order of the first completed invocation
+        std::map<std::string, size_t, std::less<>> index;
+    };
+
+    entries_t& entries()
+    {
+        static entries_t entries;
+        return entries;
+    }
+
+    thread_local Scope* current_scope{nullptr};
+
+    inline double seconds(std::chrono::steady_clock::duration duration) { return std::chrono::duration<double>(duration).count(); }
+
+    std::string json_string(std::string_view source)
+    {
+        std::string result{"\""};
+        for (const char ch : source) {
+            switch (ch) {
+                case '"':
+                case '\\':
+                    result.append(1, '\\').append(1, ch);
+                    break;
+                default:
+                    if (static_cast<unsigned char>(ch) < 0x20)
+                        result.append(fmt::format("\\u{:04x}", static_cast<unsigned>(ch)));
+                    else
+                        result.append(1, ch);
+                    break;
+            }
+        }
+        result.append(1, '"');
+        return result;
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::profile::enable(bool on)
+{
+    auto& ent = entries();
+    std::unique_lock lock{ent.access};
+    ent.entries.clear();
+    ent.index.clear();
+    detail::enabled.store(on);
+
+} // acmacs::tal::v3::profile::enable
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::profile::Scope::Scope(std::string_view name)
+    : active_{enabled()}
+{
+    if (active_) {
+        name_.assign(name);
+        parent_ = current_scope;
+        current_scope = this;
+        allocations_ = detail::allocations.load(std::memory_order_relaxed);
+        allocated_bytes_ = detail::allocated_bytes.load(std::memory_order_relaxed);
+        tree_traversals_ = detail::tree_traversals.load(std::memory_order_relaxed);
+        start_ = clock::now();
+    }
+
+} // acmacs::tal::v3::profile::Scope::Scope
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::profile::Scope::~Scope()
+{
+    if (!active_)
+        return;
+
+    const auto elapsed = clock::now() - start_;
+    const auto allocations = detail::allocations.load(std::memory_order_relaxed) - allocations_;
+    const auto allocated_bytes = detail::allocated_bytes.load(std::memory_order_relaxed) - allocated_bytes_;
+    const auto tree_traversals = detail::tree_traversals.load(std::memory_order_relaxed) - tree_traversals_;
+    current_scope = parent_;
+    if (parent_)
+        parent_->nested_ += elapsed;
+
+    auto& ent = entries();
+    std::unique_lock lock{ent.access};
+    auto found = ent.index.find(name_);
+    if (found == ent.index.end()) {
+        found = ent.index.emplace(name_, ent.entries.size()).first;
+        ent.entries.push_back(entry_t{.name = name_});
+    }
+    auto& entry = ent.entries[found->second];
+    ++entry.calls;
+    entry.total += elapsed;
+    entry.self += elapsed - nested_;
+    entry.allocations += allocations;
+    entry.allocated_bytes += allocated_bytes;
+    entry.tree_traversals += tree_traversals;
+
+} // acmacs::tal::v3::profile::Scope::~Scope
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::tal::v3::profile::type_name(const std::type_info& type)
+{
+    using namespace std::string_view_literals;
+    int status{0};
+    std::unique_ptr<char, decltype(&std::free)> demangled{abi::__cxa_demangle(type.name(), nullptr, nullptr, &status), &std::free};
+    std::string name{status == 0 && demangled ? demangled.get() : type.name()};
+    for (const auto prefix : {"acmacs::tal::v3::"sv, "acmacs::tal::"sv}) {
+        if (name.starts_with(prefix)) {
+            name.erase(0, prefix.size());
+            break;
+        }
+    }
+    return name;
+
+} // acmacs::tal::v3::profile::type_name
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::tal::v3::profile::report_table()
+{
+    auto& ent = entries();
+    std::unique_lock lock{ent.access};
+    std::vector<const entry_t*> sorted(ent.entries.size());
+    std::transform(std::begin(ent.entries), std::end(ent.entries), std::begin(sorted), [](const auto& entry) { return &entry; });
+    std::sort(std::begin(sorted), std::end(sorted), [](const auto* e1, const auto* e2) { return e1->total > e2->total; });
+
+    const auto name_width = std::accumulate(std::begin(sorted), std::end(sorted), size_t{9}, [](size_t width, const auto* entry) { return std::max(width, entry->name.size()); });
+    fmt::memory_buffer out;
+    fmt::format_to(std::back_inserter(out), "{:<{}s} {:>6s} {:>10s} {:>10s} {:>10s} {:>12s} {:>10s}\n", "directive", name_width, "calls", "total,s", "self,s", "allocs", "alloc bytes", "traversals");
+    for (const auto* entry : sorted)
+        fmt::format_to(std::back_inserter(out), "{:<{}s} {:6d} {:10.4f} {:10.4f} {:10d} {:12d} {:10d}\n", entry->name, name_width, entry->calls, seconds(entry->total), seconds(entry->self),
+                       entry->allocations, entry->allocated_bytes, entry->tree_traversals);
+    return fmt::to_string(out);
+
+} // acmacs::tal::v3::profile::report_table
+
+// ----------------------------------------------------------------------
+
+std::string acmacs::tal::v3::profile::report_json()
+{
+    auto& ent = entries();
+    std::unique_lock lock{ent.access};
+    fmt::memory_buffer out;
+    fmt::format_to(std::back_inserter(out), "{{\"version\": \"tal-profile-v1\",\n \"entries\": [");
+    for (auto entry = std::begin(ent.entries); entry != std::end(ent.entries); ++entry) {
+        fmt::format_to(std::back_inserter(out),
+                       "{}\n  {{\"name\": {}, \"calls\": {}, \"total_s\": {:.6f}, \"self_s\": {:.6f}, \"allocations\": {}, \"allocated_bytes\": {}, \"tree_traversals\": {}}}",
+                       entry == std::begin(ent.entries) ? "" : ",", json_string(entry->name), entry->calls, seconds(entry->total), seconds(entry->self), entry->allocations,
+                       entry->allocated_bytes, entry->tree_traversals);
+    }
+    fmt::format_to(std::back_inserter(out), "\n ]\n}}\n");
+    return fmt::to_string(out);
+
+} // acmacs::tal::v3::profile::report_json
+
+// ----------------------------------------------------------------------
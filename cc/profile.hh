@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <typeinfo>
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3::profile
+{
+    namespace detail
+    {
+        extern std::atomic<bool> enabled;
+        extern std::atomic<size_t> allocations;
+        extern std::atomic<size_t> allocated_bytes;
+        extern std::atomic<size_t> tree_traversals;
+
+    } // namespace detail
+
+    inline bool enabled() { return detail::enabled.load(std::memory_order_relaxed); }
+    void enable(bool on); // clears collected data
+
+    // called by tree::iterate_* when a traversal of the whole tree starts
+    inline void tree_traversal()
+    {
+        if (enabled())
+            detail::tree_traversals.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Time, allocations (global operator new) and tree traversals between construction and destruction are added to the
+    // entry with the name. Nested scopes are included into the enclosing one, its self time excludes them.
+    // Allocations are counted by operator new replaced in the tal program (profile-alloc.cc), zero in other programs using libtal.
+    // Counters are process wide, tal does not allow profiling of concurrent batch jobs and served requests.
+    class Scope
+    {
+      public:
+        Scope(std::string_view name); // does nothing if profiling is not enabled
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope();
+
+      private:
+        using clock = std::chrono::steady_clock;
+
+        bool active_;
+        std::string name_;
+        clock::time_point start_;
+        size_t allocations_{0};
+        size_t allocated_bytes_{0};
+        size_t tree_traversals_{0};
+        clock::duration nested_{0};
+        Scope* parent_{nullptr};
+    };
+
+    std::string type_name(const std::type_info& type); // demangled without acmacs::tal::v3::
+
+    std::string report_table(); // sorted by total time
+    std::string report_json();  // in the order of the first completed invocation
+
+} // namespace acmacs::tal::inline v3::profile
+
+// ----------------------------------------------------------------------
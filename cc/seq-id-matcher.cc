@@ -0,0 +1,153 @@
+#include <map>
+#include <mutex>
+#include <deque>
+#include <algorithm>
+
+#include "acmacs-tal/seq-id-matcher.hh"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    inline bool is_literal(std::string_view pattern)
+    {
+        return pattern.find_first_of(R"(\^$.|?*+()[]{})") == std::string_view::npos;
+    }
+
+    inline uint8_t fold(char ch)
+    {
+        const auto uch = static_cast<uint8_t>(ch);
+        return (uch >= 'a' && uch <= 'z') ? static_cast<uint8_t>(uch - 'a' + 'A') : uch;
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::SeqIdMatcher::SeqIdMatcher(const std::vector<std::string>& patterns)
+    : number_of_patterns_{patterns.size()}
+{
+    std::vector<std::pair<size_t, std::string_view>> literals;
+    for (size_t no = 0; no < patterns.size(); ++no) {
+        if (is_literal(patterns[no]))
+            literals.emplace_back(no, patterns[no]);
+        else
+            regexes_.emplace_back(no, std::regex{std::begin(patterns[no]), std::end(patterns[no]), std::regex_constants::ECMAScript | std::regex_constants::icase | std::regex_constants::optimize});
+    }
+    build_automaton(literals);
+
+} // acmacs::tal::v3::SeqIdMatcher::SeqIdMatcher
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::SeqIdMatcher::build_automaton(const std::vector<std::pair<size_t, std::string_view>>& literals)
+{
+    // alphabet is reduced to the characters present in the patterns to keep transition table small
+    for (const auto& [no, literal] : literals) {
+        for (const char ch : literal) {
+            if (const auto folded = fold(ch); class_of_[folded] == 0)
+                class_of_[folded] = static_cast<uint8_t>(number_of_classes_++);
+        }
+    }
+    for (char ch = 'a'; ch <= 'z'; ++ch)
+        class_of_[static_cast<uint8_t>(ch)] = class_of_[fold(ch)];
+
+    // trie, missing transitions are 0 (root can never be a target of a trie edge)
+    std::vector<state_t> trie(number_of_classes_, 0);
+    output_.emplace_back();
+    for (const auto& [no, literal] : literals) {
+        state_t state{0};
+        for (const char ch : literal) {
+            auto& next = trie[state * number_of_classes_ + class_of_[static_cast<uint8_t>(ch)]];
+            if (next == 0) {
+                next = static_cast<state_t>(output_.size());
+                output_.emplace_back();
+                trie.resize(output_.size() * number_of_classes_, 0);
+            }
+            state = trie[state * number_of_classes_ + class_of_[static_cast<uint8_t>(ch)]];
+        }
+        output_[state].push_back(no); // empty literal ends in root and matches any text
+    }
+
+    // breadth first: failure links turn the trie into a complete automaton, outputs of failure targets are merged
+    transitions_ = trie;
+    std::vector<state_t> failure(output_.size(), 0);
+    std::deque<state_t> queue;
+    for (size_t cls = 0; cls < number_of_classes_; ++cls) {
+        if (const auto next = trie[cls]; next != 0)
+            queue.push_back(next);
+    }
+    while (!queue.empty()) {
+        const auto state = queue.front();
+        queue.pop_front();
+        const auto& fail_output = output_[failure[state]];
+        output_[state].insert(std::end(output_[state]), std::begin(fail_output), std::end(fail_output));
+        for (size_t cls = 0; cls < number_of_classes_; ++cls) {
+            const auto fallback = transitions_[failure[state] * number_of_classes_ + cls];
+            if (const auto next = trie[state * number_of_classes_ + cls]; next != 0) {
+                failure[next] = fallback;
+                queue.push_back(next);
+            }
+            else
+                transitions_[state * number_of_classes_ + cls] = fallback;
+        }
+    }
+    for (auto& out : output_) {
+        std::sort(std::begin(out), std::end(out));
+        out.erase(std::unique(std::begin(out), std::end(out)), std::end(out));
+    }
+
+} // acmacs::tal::v3::SeqIdMatcher::build_automaton
+
+// ----------------------------------------------------------------------
+
+bool acmacs::tal::v3::SeqIdMatcher::matches_any(std::string_view text) const
+{
+    state_t state{0};
+    if (!output_[state].empty())
+        return true;
+    for (const char ch : text) {
+        state = transitions_[state * number_of_classes_ + class_of_[static_cast<uint8_t>(ch)]];
+        if (!output_[state].empty())
+            return true;
+    }
+    return std::any_of(std::begin(regexes_), std::end(regexes_), [text](const auto& en) { return std::regex_search(std::begin(text), std::end(text), en.second); });
+
+} // acmacs::tal::v3::SeqIdMatcher::matches_any
+
+// ----------------------------------------------------------------------
+
+std::vector<size_t> acmacs::tal::v3::SeqIdMatcher::matches(std::string_view text) const
+{
+    std::vector<size_t> result;
+    state_t state{0};
+    result.insert(std::end(result), std::begin(output_[state]), std::end(output_[state]));
+    for (const char ch : text) {
+        state = transitions_[state * number_of_classes_ + class_of_[static_cast<uint8_t>(ch)]];
+        result.insert(std::end(result), std::begin(output_[state]), std::end(output_[state]));
+    }
+    for (const auto& [no, re] : regexes_) {
+        if (std::regex_search(std::begin(text), std::end(text), re))
+            result.push_back(no);
+    }
+    std::sort(std::begin(result), std::end(result));
+    result.erase(std::unique(std::begin(result), std::end(result)), std::end(result));
+    return result;
+
+} // acmacs::tal::v3::SeqIdMatcher::matches
+
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const acmacs::tal::v3::SeqIdMatcher> acmacs::tal::v3::seq_id_matcher(const std::vector<std::string>& patterns)
+{
+    static std::mutex access;
+    static std::map<std::vector<std::string>, std::shared_ptr<const SeqIdMatcher>> cache;
+
+    std::unique_lock lock{access};
+    if (const auto found = cache.find(patterns); found != cache.end())
+        return found->second;
+    return cache.emplace(patterns, std::make_shared<const SeqIdMatcher>(patterns)).first->second;
+
+} // acmacs::tal::v3::seq_id_matcher
+
+// ----------------------------------------------------------------------
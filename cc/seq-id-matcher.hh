@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <regex>
+#include <memory>
+#include <cstdint>
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    // Case insensitive search of multiple patterns (ECMAScript regex syntax) in seq_ids with a single scan of the text.
+    // Patterns without regex special characters (e.g. vaccine names) are compiled into one Aho-Corasick automaton,
+    // other patterns are matched by std::regex.
+    class SeqIdMatcher
+    {
+      public:
+        SeqIdMatcher(const std::vector<std::string>& patterns);
+
+        size_t size() const { return number_of_patterns_; }
+        bool matches_any(std::string_view text) const;
+        std::vector<size_t> matches(std::string_view text) const; // indexes of matching patterns, sorted
+
+      private:
+        using state_t = uint32_t;
+
+        size_t number_of_patterns_;
+        size_t number_of_classes_{1};              // class 0: characters absent in literal patterns
+        std::array<uint8_t, 256> class_of_{};       // case folded character -> class
+        std::vector<state_t> transitions_;         // state * number_of_classes_ + class -> state
+        std::vector<std::vector<size_t>> output_;  // state -> literal patterns ending in this state
+        std::vector<std::pair<size_t, std::regex>> regexes_;
+
+        void build_automaton(const std::vector<std::pair<size_t, std::string_view>>& literals);
+    };
+
+    // compiled matchers are kept for the lifetime of the process to be reused by settings clauses and interactive reloads
+    std::shared_ptr<const SeqIdMatcher> seq_id_matcher(const std::vector<std::string>& patterns);
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
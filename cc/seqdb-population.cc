@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <optional>
+#include <atomic>
+
+#include "acmacs-tal/log.hh"
+#include "acmacs-tal/seqdb-population.hh"
+#include "acmacs-tal/parallel.hh"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    constexpr const size_t resolve_chunk_size{64};
+    std::atomic<bool> seqdb_fixed{false};
+}
+
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const acmacs::tal::v3::SeqdbPopulation::index_t> acmacs::tal::v3::SeqdbPopulation::add(std::vector<std::string> seq_ids, size_t threads)
+{
+    std::unique_lock add_lock{add_access_};
+    auto current = snapshot(); // no other add() can change it now
+
+    std::sort(std::begin(seq_ids), std::end(seq_ids));
+    seq_ids.erase(std::unique(std::begin(seq_ids), std::end(seq_ids)), std::end(seq_ids));
+    seq_ids.erase(std::remove_if(std::begin(seq_ids), std::end(seq_ids), [&current](const auto& seq_id) { return current->find(seq_id) != current->end(); }), std::end(seq_ids));
+    if (seq_ids.empty())
+        return current;
+
+    std::vector<std::optional<seqdb_leaf_data_t>> resolved(seq_ids.size());
+    const auto resolve = [this, &seq_ids, &resolved](size_t no) {
+        if (const auto subset = seqdb_.select_by_seq_id(seq_ids[no]); !subset.empty()) {
+            const auto& ref = subset.front();
+            resolved[no] = seqdb_leaf_data_t{
+                .ref = ref,
+                .aa_sequence = ref.aa_aligned(seqdb_),
+                .nuc_sequence = ref.nuc_aligned(seqdb_),
+                .strain_name = ref.entry->name,
+                .date = ref.entry->date(),
+                .continent = ref.entry->continent,
+                .country = ref.entry->country,
+                .hi_names = ref.seq().hi_names,
+                .gisaid = ref.seq().gisaid,
+            };
+        }
+    };
+    resolve(0); // seqdb builds its seq_id index upon the first search, do it before starting threads
+    parallel_for_chunks(
+        seq_ids.size() - 1, resolve_chunk_size,
+        [&resolve](size_t first, size_t last) {
+            for (size_t no = first; no < last; ++no)
+                resolve(no + 1);
+        },
+        threads);
+
+    auto index = std::make_shared<index_t>(*current);
+    for (size_t no = 0; no < seq_ids.size(); ++no) {
+        const seqdb_leaf_data_t* entry{nullptr};
+        if (resolved[no].has_value())
+            entry = &entries_.emplace_back(std::move(*resolved[no]));
+        index->emplace(std::move(seq_ids[no]), entry);
+    }
+
+    std::unique_lock lock{access_};
+    index_ = std::move(index);
+    return index_;
+
+} // acmacs::tal::v3::SeqdbPopulation::add
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::SeqdbPopulation& acmacs::tal::v3::seqdb_population()
+{
+    static SeqdbPopulation population{acmacs::seqdb::get()};
+    return population;
+
+} // acmacs::tal::v3::seqdb_population
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::seqdb_setup(std::string_view seqdb_filename)
+{
+    if (!seqdb_fixed)
+        acmacs::seqdb::setup(seqdb_filename);
+    else if (!seqdb_filename.empty())
+        AD_WARNING("seqdb \"{}\" ignored: seqdb shared by concurrent jobs cannot be changed", seqdb_filename);
+
+} // acmacs::tal::v3::seqdb_setup
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::seqdb_setup_fixed()
+{
+    seqdb_fixed = true;
+
+} // acmacs::tal::v3::seqdb_setup_fixed
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "seqdb-3/seqdb.hh"
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    // Leaf fields resolved from seqdb by seq_id, see Node::populate()
+    struct seqdb_leaf_data_t
+    {
+        acmacs::seqdb::ref ref;
+        acmacs::seqdb::sequence_aligned_ref_t aa_sequence;
+        acmacs::seqdb::sequence_aligned_ref_t nuc_sequence;
+        std::string_view strain_name;
+        std::string_view date;
+        std::string_view continent;
+        std::string_view country;
+        std::vector<std::string_view> hi_names;
+        seqdb::SeqdbSeq::gisaid_data_t gisaid;
+    };
+
+    // Resolved leaf data shared (read-only) by all trees matched against seqdb, e.g. by batch jobs and served requests.
+    // Lookups are made in an immutable snapshot of the index without locking. Seq ids missing in the snapshot are
+    // resolved by add() and published in a new snapshot, entries are never moved or removed.
+    class SeqdbPopulation
+    {
+      public:
+        using index_t = std::unordered_map<std::string, const seqdb_leaf_data_t*>; // nullptr: seq_id is not in seqdb
+
+        SeqdbPopulation(const acmacs::seqdb::Seqdb& seqdb) : seqdb_{seqdb}, index_{std::make_shared<const index_t>()} {}
+        SeqdbPopulation(const SeqdbPopulation&) = delete;
+        SeqdbPopulation& operator=(const SeqdbPopulation&) = delete;
+
+        std::shared_ptr<const index_t> snapshot() const
+        {
+            std::unique_lock lock{access_};
+            return index_;
+        }
+
+        // resolves seq_ids against seqdb in parallel (threads: 0 - number of hardware threads), returns new snapshot containing them
+        std::shared_ptr<const index_t> add(std::vector<std::string> seq_ids, size_t threads = 0);
+
+      private:
+        const acmacs::seqdb::Seqdb& seqdb_;
+        mutable std::mutex access_;
+        std::mutex add_access_; // one add() at a time, snapshot() is not blocked while seqdb is being searched
+        std::shared_ptr<const index_t> index_;
+        std::deque<seqdb_leaf_data_t> entries_;
+    };
+
+    // population of acmacs::seqdb::get()
+    SeqdbPopulation& seqdb_population();
+
+    // acmacs::seqdb::setup() for the "seqdb" directive. After seqdb_setup_fixed() (called before batch jobs or served
+    // requests start) seqdb shared by them is not changed, a filename passed by a job is ignored with a warning.
+    void seqdb_setup(std::string_view seqdb_filename);
+    void seqdb_setup_fixed();
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
@@ -0,0 +1,131 @@
+#include <cerrno>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "acmacs-tal/log.hh"
+#include "acmacs-tal/serve.hh"
+#include "acmacs-tal/parallel.hh"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    constexpr const int listen_backlog{64};
+    constexpr const auto request_timeout{std::chrono::seconds{10}}; // for the whole request, idle or slow clients must not hold workers
+    constexpr const size_t max_request_size{1024 * 1024};
+
+    // nullopt if the request is not received in time or it is too big
+    std::optional<std::string> read_request(int fd)
+    {
+        const auto deadline = std::chrono::steady_clock::now() + request_timeout;
+        std::string request;
+        std::array<char, 4096> buffer;
+        for (;;) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                AD_WARNING("serve: request not received in {}s", request_timeout.count());
+                return std::nullopt;
+            }
+            pollfd poll_fd{.fd = fd, .events = POLLIN, .revents = 0};
+            if (const auto ready = ::poll(&poll_fd, 1, static_cast<int>(left.count())); ready <= 0) {
+                if (ready < 0 && errno != EINTR) {
+                    AD_WARNING("serve: waiting for request failed: {}", std::strerror(errno));
+                    return std::nullopt;
+                }
+                continue;
+            }
+            const auto bytes = ::read(fd, buffer.data(), buffer.size());
+            if (bytes < 0 && errno == EINTR)
+                continue;
+            if (bytes <= 0)
+                break;
+            const std::string_view chunk{buffer.data(), static_cast<size_t>(bytes)};
+            if (const auto newline = chunk.find('\n'); newline != std::string_view::npos) {
+                request.append(chunk.substr(0, newline));
+                break;
+            }
+            request.append(chunk);
+            if (request.size() > max_request_size) {
+                AD_WARNING("serve: request is longer than {} bytes", max_request_size);
+                return std::nullopt;
+            }
+        }
+        return request;
+    }
+
+    void write_reply(int fd, std::string_view reply)
+    {
+        while (!reply.empty()) {
+            const auto bytes = ::send(fd, reply.data(), reply.size(), MSG_NOSIGNAL);
+            if (bytes < 0 && errno == EINTR)
+                continue;
+            if (bytes <= 0) {
+                AD_WARNING("serve: writing reply failed: {}", std::strerror(errno));
+                break;
+            }
+            reply.remove_prefix(static_cast<size_t>(bytes));
+        }
+    }
+
+    void worker(int listening, const acmacs::tal::v3::serve_handler_t& handler)
+    {
+        for (;;) {
+            const int fd = ::accept(listening, nullptr, nullptr);
+            if (fd < 0) {
+                if (errno != EINTR && errno != ECONNABORTED)
+                    AD_WARNING("serve: accept failed: {}", std::strerror(errno));
+                continue;
+            }
+            try {
+                if (const auto request = read_request(fd); request.has_value())
+                    write_reply(fd, handler(*request));
+            }
+            catch (std::exception& err) {
+                AD_ERROR("serve: {}", err);
+            }
+            ::close(fd);
+        }
+    }
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::serve(std::string_view socket_path, size_t max_concurrent, const serve_handler_t& handler)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+        throw ServeError{fmt::format("socket path too long: {}", socket_path)};
+    std::copy(std::begin(socket_path), std::end(socket_path), address.sun_path);
+
+    const int listening = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listening < 0)
+        throw ServeError{fmt::format("cannot create socket: {}", std::strerror(errno))};
+    ::unlink(address.sun_path); // stale socket of the previous run
+    if (::bind(listening, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listening, listen_backlog) != 0) {
+        const auto message = fmt::format("cannot listen on {}: {}", socket_path, std::strerror(errno));
+        ::close(listening);
+        throw ServeError{message};
+    }
+
+    const auto threads = number_of_threads(max_concurrent);
+    AD_INFO("serving on {}, {} concurrent requests", socket_path, threads);
+    std::vector<std::thread> workers;
+    for (size_t thread_no = 0; thread_no < threads; ++thread_no)
+        workers.emplace_back(worker, listening, std::cref(handler));
+    for (auto& thread : workers)
+        thread.join();
+
+} // acmacs::tal::v3::serve
+
+// ----------------------------------------------------------------------
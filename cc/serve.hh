@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <stdexcept>
+
+// ----------------------------------------------------------------------
+
+namespace acmacs::tal::inline v3
+{
+    class ServeError : public std::runtime_error { public: using std::runtime_error::runtime_error; };
+
+    // handler receives request (up to the first newline or end of input) and returns reply (may contain binary data),
+    // connection is closed without reply if request is not received within 10 seconds or it is longer than 1MiB
+    using serve_handler_t = std::function<std::string(std::string_view request)>;
+
+    // Listens on the unix domain socket, every connection is a single request-reply exchange.
+    // Up to max_concurrent (0 - number of hardware threads) requests are handled at the same time, other connections wait in the listen queue.
+    // Does not return unless listening fails.
+    void serve(std::string_view socket_path, size_t max_concurrent, const serve_handler_t& handler);
+
+} // namespace acmacs::tal::inline v3
+
+// ----------------------------------------------------------------------
@@ -15,6 +15,7 @@
 #include "acmacs-tal/draw-aa-transitions.hh"
 #include "acmacs-tal/hz-sections.hh"
 #include "acmacs-tal/antigenic-maps.hh"
+#include "acmacs-tal/profile.hh"
 
 // ----------------------------------------------------------------------
 
@@ -32,7 +33,7 @@ inline void extract_coordinates(const rjson::v3::value& source, acmacs::PointCoo
 
 // ======================================================================
 
-size_t acmacs::tal::v3::Settings::uniq_id = 0;
+std::atomic<size_t> acmacs::tal::v3::Settings::uniq_id{0};
 
 template <typename ElementType, typename... Args> ElementType& acmacs::tal::v3::Settings::add_element(Args&&... args, add_unique uniq)
 {
@@ -120,6 +121,7 @@ void acmacs::tal::v3::Settings::update_env()
 bool acmacs::tal::v3::Settings::apply_built_in(std::string_view name)
 {
     // Timeit time_apply(fmt::format(">>>> applying {}: ", name), verb == verbose::yes ? report_time::yes : report_time::no);
+    const profile::Scope profile_scope{name};
     using namespace std::string_view_literals;
     try {
         // printenv();
@@ -409,51 +411,82 @@ std::string acmacs::tal::v3::Settings::report_nodes(std::string_view indent, con
 acmacs::tal::v3::NodeSet acmacs::tal::v3::Settings::select_nodes(const rjson::v3::value& criteria) const
 {
     using namespace std::string_view_literals;
-    NodeSet selected;
+
+    // compiled queries are cached by criteria after substitution, the same "select" used with different environment is compiled again
+    std::string signature;
     bool report = false;
-    auto update = Tree::Select::init;
     for (const auto& [key, val_raw] : criteria.object()) {
+        if (!key.empty() && key[0] == '?')
+            continue;
+        const auto& val = substitute(val_raw);
+        if (key == "report"sv)
+            report = val.to<bool>();
+        else
+            fmt::format_to(std::back_inserter(signature), "{}:{}\n", key, val);
+    }
+
+    auto found = node_queries_.find(signature);
+    if (found == node_queries_.end())
+        found = node_queries_.emplace(std::move(signature), compile_node_query(criteria)).first;
+    const auto& query = found->second;
+
+    if (query.needs_chart()) {
+        if (!tal_.chart_present())
+            throw acmacs::settings::v3::error{"cannot select node that matches chart antigen or serum: no chart given"};
+        tree().match(tal_.chart());
+    }
+
+    const auto selected = query.select(tree(), [this](std::string_view vaccine_type) { return vaccine_names(vaccine_type); });
+    if (report)
+        AD_INFO("{} selected nodes {}\n{}", selected.size(), criteria, report_nodes("  ", selected));
+    return selected;
+
+} // acmacs::tal::v3::Settings::select_nodes
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::NodeQuery acmacs::tal::v3::Settings::compile_node_query(const rjson::v3::value& criteria) const
+{
+    using namespace std::string_view_literals;
+    NodeQuery query;
+    for (const auto& [key, val_raw] : criteria.object()) {
+        if (!key.empty() && key[0] == '?')
+            continue;
         const auto& val = substitute(val_raw);
         if (key == "all"sv) {
-            tree().select_all(selected, update);
+            query.all();
         }
         else if (key == "all-and-intermediate"sv) {
-            tree().select_all_and_intermediate(selected, update);
+            query.all_and_intermediate();
         }
         else if (key == "aa"sv) {
-            tree().select_by_aa(selected, update, acmacs::seqdb::extract_aa_at_pos1_eq_list(val));
+            query.aa(acmacs::seqdb::extract_aa_at_pos1_eq_list(val));
         }
         else if (key == "nuc"sv) {
-            tree().select_by_nuc(selected, update, acmacs::seqdb::extract_nuc_at_pos1_eq_list(val));
+            query.nuc(acmacs::seqdb::extract_nuc_at_pos1_eq_list(val));
         }
         else if (key == "country"sv) {
-            tree().select_by_country(selected, update, val.to<std::string_view>());
+            query.country(val.to<std::string_view>());
         }
         else if (key == "cumulative >="sv) {
-            tree().select_if_cumulative_more_than(selected, update, val.to<double>());
+            query.cumulative_more_than(val.to<double>());
         }
         else if (key == "date"sv) {
-            tree().select_by_date(selected, update, val[0].to<std::string_view>(), val[1].to<std::string_view>());
+            query.date(val[0].to<std::string_view>(), val[1].to<std::string_view>());
         }
         else if (key == "edge >="sv) {
-            tree().select_if_edge_more_than(selected, update, val.to<double>());
+            query.edge_more_than(val.to<double>());
         }
         else if (key == "edge >= mean_edge of"sv) {
-            tree().select_if_edge_more_than_mean_edge_of(selected, update, val.to<double>());
+            query.edge_more_than_mean_edge_of(val.to<double>());
         }
         else if (key == "location"sv) {
-            tree().select_by_location(selected, update, val.to<std::string_view>());
+            query.location(val.to<std::string_view>());
         }
         else if (key == "matches-chart-antigen"sv) {
-            if (!tal_.chart_present())
-                throw acmacs::settings::v3::error{"cannot select node that matches chart antigen: no chart given"};
-            tree().match(tal_.chart());
-            tree().select_matches_chart_antigens(selected, update);
+            query.matches_chart_antigens();
         }
         else if (key == "matches-chart-serum"sv) {
-            if (!tal_.chart_present())
-                throw acmacs::settings::v3::error{"cannot select node that matches chart antigen: no chart given"};
-            tree().match(tal_.chart());
             Tree::serum_match_t mt{Tree::serum_match_t::name};
             if (const auto match_type = val.to<std::string_view>(); match_type == "reassortant"sv)
                 mt = Tree::serum_match_t::reassortant;
@@ -461,30 +494,33 @@ acmacs::tal::v3::NodeSet acmacs::tal::v3::Settings::select_nodes(const rjson::v3
                 mt = Tree::serum_match_t::passage_type;
             else if (match_type != "name"sv)
                 AD_WARNING("unrecognized \"matches-chart-serum\" value: \"{}\", \"name\" assumed", match_type);
-            tree().select_matches_chart_sera(selected, update, mt);
+            query.matches_chart_sera(mt);
         }
         else if (key == "seq_id"sv) {
-            tree().select_by_seq_id(selected, update, val.to<std::string_view>());
+            query.seq_id(val.to<std::string_view>());
         }
         else if (key == "report"sv) {
-            report = val.to<bool>();
+            // handled by select_nodes
         }
         else if (key == "top-cumulative-gap"sv) {
-            tree().select_by_top_cumulative_gap(selected, update, val.to<double>());
+            query.top_cumulative_gap(val.to<double>());
         }
         else if (key == "vaccine"sv) {
-            select_vaccine(selected, update, val);
+            NodeQuery::passage_t passage{NodeQuery::passage_t::any};
+            if (const auto passage_s = ::string::lower(rjson::v3::get_or(val, "passage"sv, ""sv)); passage_s == "cell"sv)
+                passage = NodeQuery::passage_t::cell;
+            else if (passage_s == "egg"sv)
+                passage = NodeQuery::passage_t::egg;
+            else if (passage_s == "reassortant"sv)
+                passage = NodeQuery::passage_t::reassortant;
+            query.vaccine(rjson::v3::get_or(val, "type"sv, "any"sv), passage);
         }
-        else if (key.empty() || key[0] != '?')
+        else
             throw acmacs::settings::v3::error{fmt::format("unrecognized select node criterium: {}", key)};
-        if (key != "report"sv)
-            update = Tree::Select::update;
     }
-    if (report)
-        AD_INFO("{} selected nodes {}\n{}", selected.size(), criteria, report_nodes("  ", selected));
-    return selected;
+    return query;
 
-} // acmacs::tal::v3::Settings::select_nodes
+} // acmacs::tal::v3::Settings::compile_node_query
 
 // ----------------------------------------------------------------------
 
@@ -510,8 +546,10 @@ void acmacs::tal::v3::Settings::clade() const
     else
         throw error{"neither \"aa\" nor \"nuc\" provided"};
 
-    if (report)
+    if (report) {
+        tree().make_clade_sections();
         tree().clade_report(clade_name);
+    }
 
 } // acmacs::tal::v3::Settings::clade
 
@@ -1415,7 +1453,7 @@ void acmacs::tal::v3::Settings::report_aa_at() const
 
 // ----------------------------------------------------------------------
 
-void acmacs::tal::v3::Settings::select_vaccine(NodeSet& nodes, Tree::Select update, const rjson::v3::value& criteria) const
+std::vector<std::string> acmacs::tal::v3::Settings::vaccine_names(std::string_view vaccine_type) const
 {
     using namespace std::string_view_literals;
 
@@ -1423,44 +1461,14 @@ void acmacs::tal::v3::Settings::select_vaccine(NodeSet& nodes, Tree::Select upda
     const acmacs::virus::lineage_t lineage{getenv_or("lineage"sv, ""sv)};
     AD_LOG(acmacs::log::vaccines, "select_vaccine virus-type: \"{}\" lineage: \"{}\"", virus_type, lineage);
 
-    const auto names = ranges::to<std::vector<std::string>>(
+    auto names = ranges::to<std::vector<std::string>>(
         acmacs::whocc::vaccine_names(virus_type, lineage)
-        | ranges::views::filter([vaccine_type=acmacs::whocc::Vaccine::type_from_string(rjson::v3::get_or(criteria, "type"sv, "any"sv))](const auto& en) { return vaccine_type == acmacs::whocc::vaccine_type::any || en.type == vaccine_type; })
+        | ranges::views::filter([vaccine_type=acmacs::whocc::Vaccine::type_from_string(vaccine_type)](const auto& en) { return vaccine_type == acmacs::whocc::vaccine_type::any || en.type == vaccine_type; })
         | ranges::views::transform([](const auto& en) { return en.name; }));
 
     AD_LOG(acmacs::log::vaccines, "{}", names);
-    NodeSet selected_nodes;
-    for (const auto& name : names) {
-        NodeSet some_nodes;
-        tree().select_by_seq_id(some_nodes, Tree::Select::init, *acmacs::seqdb::make_seq_id(name));
-        selected_nodes.add(some_nodes);
-    }
-
-    if (const auto passage = ::string::lower(rjson::v3::get_or(criteria, "passage"sv, ""sv)); !passage.empty()) {
-        const auto exclude_by_passage = [&passage](const auto* node) {
-            const auto name = acmacs::virus::name::parse(node->seq_id);
-            if (passage == "cell"sv)
-                return !name.passage.is_cell();
-            else if (passage == "egg"sv)
-                return !name.passage.is_egg();
-            else if (passage == "reassortant"sv)
-                return name.reassortant.empty();
-            else
-                return false;
-        };
-        selected_nodes.erase(std::remove_if(std::begin(selected_nodes), std::end(selected_nodes), exclude_by_passage), std::end(selected_nodes));
-    }
-
-    switch (update) {
-      case Tree::Select::init:
-          nodes = selected_nodes;
-          break;
-      case Tree::Select::update:
-          nodes.filter(selected_nodes);
-          break;
-    }
-    // AD_INFO("{} selected nodes {}", selected.size(), getenv("select"sv), report_nodes("  ", nodes));
+    return names;
 
-} // acmacs::tal::v3::Settings::select_vaccine
+} // acmacs::tal::v3::Settings::vaccine_names
 
 // ----------------------------------------------------------------------
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
+#include <map>
 
 #include "acmacs-base/settings-v3.hh"
 #include "acmacs-tal/tal-data.hh"
+#include "acmacs-tal/node-query.hh"
 #include "acmacs-tal/clades.hh"
 #include "acmacs-tal/time-series.hh"
 
@@ -32,7 +35,8 @@ namespace acmacs::tal::inline v3
 
       private:
         Tal& tal_;
-        static size_t uniq_id;   // thread unsafe!
+        static std::atomic<size_t> uniq_id; // shared by batch jobs
+        mutable std::map<std::string, NodeQuery, std::less<>> node_queries_; // compiled "select" criteria, see select_nodes()
 
         Tree& tree() const { return tal_.tree(); }
         Draw& draw() const { return tal_.draw(); }
@@ -44,7 +48,8 @@ namespace acmacs::tal::inline v3
         void canvas();
         void apply_nodes() const;
         void clade() const;
-        void select_vaccine(NodeSet& nodes, Tree::Select update, const rjson::v3::value& criteria) const;
+        NodeQuery compile_node_query(const rjson::v3::value& criteria) const;
+        std::vector<std::string> vaccine_names(std::string_view vaccine_type) const;
         void ladderize();
         void margins();
         void outline(DrawOutline& draw_outline);
@@ -2,6 +2,7 @@
 #include "acmacs-chart-2/factory-import.hh"
 #include "acmacs-base/timeit.hh"
 #include "acmacs-tal/tal-data.hh"
+#include "acmacs-tal/export-pipeline.hh"
 #include "acmacs-tal/aa-transition.hh"
 
 // ----------------------------------------------------------------------
@@ -18,11 +19,19 @@ void acmacs::tal::v3::Tal::import_tree(std::string_view filename)
 
 // ----------------------------------------------------------------------
 
+void acmacs::tal::v3::Tal::import_tree(std::shared_ptr<const Tree> source)
+{
+    tree_ = *source; // data buffer is shared, not copied
+
+} // acmacs::tal::v3::Tal::import_tree
+
+// ----------------------------------------------------------------------
+
 void acmacs::tal::v3::Tal::import_chart(std::string_view filename)
 {
     if (!filename.empty()) {
         chart_ = acmacs::chart::import_from_file(filename);
-
+        tree_.artifacts().invalidate(artifact_t::chart_match);
     }
 } // acmacs::tal::v3::Tal::import_chart
 
@@ -31,6 +40,10 @@ void acmacs::tal::v3::Tal::import_chart(std::string_view filename)
 void acmacs::tal::v3::Tal::reset()
 {
     reset_aa_transitions(tree());
+    // produced by layout elements which are re-created by settings
+    tree().artifacts().invalidate(artifact_t::coloring);
+    tree().artifacts().invalidate(artifact_t::hz_sections);
+    tree().artifacts().invalidate(artifact_t::vertical_offsets);
     draw().reset();
 
 } // acmacs::tal::v3::Tal::reset
@@ -40,6 +53,7 @@ void acmacs::tal::v3::Tal::reset()
 void acmacs::tal::v3::Tal::prepare()
 {
     draw().prepare();
+    AD_LOG(acmacs::log::tree, "not computed after prepare: {}", tree().artifacts().report());
 
 } // acmacs::tal::v3::Tal::prepare
 
@@ -59,3 +73,18 @@ void acmacs::tal::v3::Tal::export_tree(std::string_view filename, const ExportOp
 } // acmacs::tal::v3::Tal::export_tree
 
 // ----------------------------------------------------------------------
+
+void acmacs::tal::v3::Tal::export_trees(const std::vector<std::string_view>& filenames, const ExportOptions& options)
+{
+    std::vector<std::string_view> tree_outputs;
+    for (const auto filename : filenames) {
+        if (fs::path{filename}.extension() == ".pdf")
+            draw().export_pdf(filename);
+        else
+            tree_outputs.push_back(filename);
+    }
+    acmacs::tal::export_trees(tree_outputs, tree_, options);
+
+} // acmacs::tal::v3::Tal::export_trees
+
+// ----------------------------------------------------------------------
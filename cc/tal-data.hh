@@ -24,8 +24,12 @@ namespace acmacs::tal::inline v3
         Tal() = default;
 
         void import_tree(std::string_view filename);
+        // copy of a tree imported elsewhere (FileCache), data buffer the nodes refer to is shared with the source
+        void import_tree(std::shared_ptr<const Tree> source);
         void import_chart(std::string_view filename);
+        void chart(acmacs::chart::ChartP chart) { chart_ = chart; tree_.artifacts().invalidate(artifact_t::chart_match); } // chart imported (and shared) elsewhere
         void export_tree(std::string_view filename, const ExportOptions& options);
+        void export_trees(const std::vector<std::string_view>& filenames, const ExportOptions& options); // pdf is drawn, other formats are exported in one tree traversal
 
         void reset();
         void prepare();
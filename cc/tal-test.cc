@@ -0,0 +1,181 @@
+#include "acmacs-base/argv.hh"
+#include "acmacs-base/filesystem.hh"
+#include "acmacs-base/read-file.hh"
+#include "acmacs-tal/log.hh"
+#include "acmacs-tal/tree.hh"
+#include "acmacs-tal/import-export.hh"
+#include "acmacs-tal/export-pipeline.hh"
+#include "acmacs-tal/json-export.hh"
+#include "acmacs-tal/newick.hh"
+#include "acmacs-tal/seq-id-matcher.hh"
+#include "acmacs-tal/leaf-attributes.hh"
+
+// ----------------------------------------------------------------------
+
+using namespace acmacs::argv;
+struct Options : public argv
+{
+    Options(int a_argc, const char* const a_argv[], on_error on_err = on_error::exit) : argv() { parse(a_argc, a_argv, on_err); }
+
+    argument<str> tree_file{*this, arg_name{"tree.json.xz"}, mandatory};
+    argument<str> temp_dir{*this, arg_name{"temp-dir"}, mandatory};
+};
+
+class test_failure : public std::runtime_error { public: using std::runtime_error::runtime_error; };
+
+static void test_json_round_trip(std::string_view tree_file, const fs::path& temp_dir);
+static void test_newick_parallel(std::string_view tree_file);
+static void test_seq_id_matcher();
+static void test_date_from();
+static void test_leaf_bitset();
+
+int main(int argc, const char* argv[])
+{
+    try {
+        Options opt(argc, argv);
+        test_json_round_trip(opt.tree_file, fs::path{std::string_view{opt.temp_dir}});
+        test_newick_parallel(opt.tree_file);
+        test_seq_id_matcher();
+        test_date_from();
+        test_leaf_bitset();
+        return 0;
+    }
+    catch (std::exception& err) {
+        AD_ERROR("{}", err);
+        return 1;
+    }
+}
+
+// ----------------------------------------------------------------------
+
+static inline void check(bool condition, std::string_view what)
+{
+    if (!condition)
+        throw test_failure{fmt::format("test failed: {}", what)};
+
+} // check
+
+// ----------------------------------------------------------------------
+
+// json export with the "date" line (time of export) removed
+static std::string json_without_date(const acmacs::tal::Tree& tree)
+{
+    auto json = acmacs::tal::json_export(tree);
+    if (const auto start = json.find("\"  date\""); start != std::string::npos)
+        json.erase(start, json.find('\n', start) - start);
+    return json;
+
+} // json_without_date
+
+// ----------------------------------------------------------------------
+
+// tape importer reads what streaming json and .tjz writers produce
+void test_json_round_trip(std::string_view tree_file, const fs::path& temp_dir)
+{
+    acmacs::tal::Tree source;
+    acmacs::tal::import_tree(tree_file, source);
+    const auto expected = json_without_date(source);
+    check(expected.find("A/PANAMA/318587/2016__MDCK1") != std::string::npos, "json export of the imported tree contains leaf");
+
+    const auto json_file = (temp_dir / "round-trip.json").string(), tjz_file = (temp_dir / "round-trip.tjz").string();
+    acmacs::tal::export_trees({json_file, tjz_file}, source, acmacs::tal::ExportOptions{.compression_threads = 2});
+
+    for (const auto& filename : {json_file, tjz_file}) {
+        acmacs::tal::Tree imported;
+        acmacs::tal::import_tree(filename, imported);
+        check(json_without_date(imported) == expected, fmt::format("json round trip via {}", filename));
+    }
+
+    // misplaced or missing separators are not accepted
+    const auto malformed_file = (temp_dir / "malformed.json").string();
+    for (const auto* malformed : {R"({"tree" {"n" "x"}})", R"({"tree": {"t": [{"n": "x"} {"n": "y"}]}})", R"({"tree": {"t": [{"n": "x"},]}})", R"({"tree":: {"n": "x"}})"}) {
+        acmacs::file::write(malformed_file, malformed);
+        bool rejected{false};
+        try {
+            acmacs::tal::Tree imported;
+            acmacs::tal::import_tree(malformed_file, imported);
+        }
+        catch (std::exception&) {
+            rejected = true;
+        }
+        check(rejected, fmt::format("malformed json rejected: {}", malformed));
+    }
+    AD_INFO("json round trip: OK");
+
+} // test_json_round_trip
+
+// ----------------------------------------------------------------------
+
+// subtrees formatted concurrently are joined in the tree order
+void test_newick_parallel(std::string_view tree_file)
+{
+    acmacs::tal::Tree tree;
+    acmacs::tal::import_tree(tree_file, tree);
+    const auto sequential = acmacs::tal::newick_export(tree, acmacs::tal::ExportOptions{.export_threads = 1});
+    check(!sequential.empty() && sequential.back() == ';', "newick export ends with ;");
+    for (const size_t threads : {2UL, 4UL, 16UL})
+        check(acmacs::tal::newick_export(tree, acmacs::tal::ExportOptions{.export_threads = threads}) == sequential, fmt::format("newick export with {} threads is identical to sequential", threads));
+    AD_INFO("newick parallel export: OK");
+
+} // test_newick_parallel
+
+// ----------------------------------------------------------------------
+
+void test_seq_id_matcher()
+{
+    const acmacs::tal::SeqIdMatcher matcher{{"BRISBANE/132", "^A/SYDNEY/", "vermont", "2016__MDCK[0-9]$"}};
+    check(matcher.size() == 4, "SeqIdMatcher size");
+    check(matcher.matches("A/BRISBANE/132/2016__MDCK2") == std::vector<size_t>{0, 3}, "literal and regex patterns");
+    check(matcher.matches("A/SYDNEY/1006/2016__MDCK1") == std::vector<size_t>{1, 3}, "anchored regex pattern");
+    check(matcher.matches("A/VERMONT/31/2016__OR") == std::vector<size_t>{2}, "case insensitive literal pattern");
+    check(matcher.matches("A/BRISBANE/13/2016__OR").empty(), "no match for prefix of literal pattern");
+    check(!matcher.matches_any("B/SYDNEY/1/2016__OR"), "anchored regex does not match in the middle");
+    check(matcher.matches_any("a/brisbane/132/2017"), "case insensitive matches_any");
+    AD_INFO("SeqIdMatcher: OK");
+
+} // test_seq_id_matcher
+
+// ----------------------------------------------------------------------
+
+void test_date_from()
+{
+    using LA = acmacs::tal::LeafAttributes;
+    check(LA::date_from("") == 0, "empty date");
+    check(LA::date_from("2020-01-15") == 2020 * 1024 + 2 * 64 + 16, "full date");
+    for (const auto* invalid : {"20", "2020-", "2020-13", "2020-01-32", "2020/01/01", "20x0-01-01"})
+        check(LA::date_from(invalid) == LA::unparsable_date, fmt::format("unparsable date \"{}\"", invalid));
+    // the order of strings is kept
+    const std::vector<std::string_view> ordered{"2019-12-31", "2020", "2020-00", "2020-01", "2020-01-00", "2020-01-01", "2020-02", "2021"};
+    for (size_t no = 1; no < ordered.size(); ++no)
+        check(LA::date_from(ordered[no - 1]) < LA::date_from(ordered[no]), fmt::format("date order \"{}\" < \"{}\"", ordered[no - 1], ordered[no]));
+    AD_INFO("LeafAttributes::date_from: OK");
+
+} // test_date_from
+
+// ----------------------------------------------------------------------
+
+void test_leaf_bitset()
+{
+    const auto runs = [](const acmacs::tal::LeafBitset& bitset) {
+        std::vector<std::pair<size_t, size_t>> result;
+        bitset.for_each_run([&result](size_t first, size_t last) { result.emplace_back(first, last); });
+        return result;
+    };
+    using runs_t = std::vector<std::pair<size_t, size_t>>;
+
+    acmacs::tal::LeafBitset bitset{200};
+    check(runs(bitset).empty(), "no runs in empty set");
+    for (const size_t vertical : {0UL, 1UL, 2UL, 63UL, 64UL, 100UL, 127UL, 128UL, 129UL, 199UL})
+        bitset.insert(vertical);
+    check(runs(bitset) == runs_t{{0, 2}, {63, 64}, {100, 100}, {127, 129}, {199, 199}}, "runs across word boundaries");
+    check(bitset.size() == 10, "LeafBitset size");
+
+    acmacs::tal::LeafBitset full{128};
+    for (size_t vertical = 0; vertical < 128; ++vertical)
+        full.insert(vertical);
+    check(runs(full) == runs_t{{0, 127}}, "single run of all leaves");
+    AD_INFO("LeafBitset::for_each_run: OK");
+
+} // test_leaf_bitset
+
+// ----------------------------------------------------------------------
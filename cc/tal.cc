@@ -1,16 +1,30 @@
 #include <unistd.h>
 #include <signal.h>
+#include <atomic>
+#include <chrono>
 
 #include "acmacs-base/string-compare.hh"
 #include "acmacs-base/argv.hh"
 #include "acmacs-base/quicklook.hh"
 #include "acmacs-base/timeit.hh"
 #include "acmacs-base/coredump.hh"
+#include "acmacs-base/read-file.hh"
+#include "acmacs-base/string-split.hh"
+#include "acmacs-base/filesystem.hh"
+#include "acmacs-base/rjson-v3-helper.hh"
+#include "acmacs-chart-2/factory-import.hh"
 #include "seqdb-3/seqdb.hh"
 #include "acmacs-tal/log.hh"
 #include "acmacs-tal/tal-data.hh"
+#include "acmacs-tal/aa-transition.hh"
 #include "acmacs-tal/settings.hh"
 #include "acmacs-tal/antigenic-maps.hh"
+#include "acmacs-tal/parallel.hh"
+#include "acmacs-tal/file-cache.hh"
+#include "acmacs-tal/serve.hh"
+#include "acmacs-tal/profile.hh"
+#include "acmacs-tal/file-watch.hh"
+#include "acmacs-tal/seqdb-population.hh"
 
 // ----------------------------------------------------------------------
 
@@ -27,13 +41,20 @@ struct Options : public argv
     option<str>       chart_file{*this, "chart", desc{"path to a chart for the signature page"}};
     option<size_t>    first_last_leaves{*this, "first-last-leaves", desc{"min num of leaves per node to print"}};
     option<bool> export_aa_transion_labels{*this, "export-aa-transion-labels", desc{"for exporting into newick"}};
+    option<size_t>    html_chunk_leaves{*this, "html-chunk-leaves", dflt{0UL}, desc{"export .html as a page with subtrees loaded on demand, about that many leaves per chunk"}};
+    option<size_t>    compression_threads{*this, "compression-threads", dflt{1UL}, desc{"threads to use for xz compression of .tjz and .json.xz output, 0 - number of hardware threads"}};
+    option<str>       profile_json{*this, "profile-json", desc{"write time, allocations and tree traversals per settings directive and layout element prepare stage to the file (json), -v profile prints them"}};
+
+    option<str>       batch{*this, "batch", desc{"job manifest: one job per line with tal arguments (-s, -D, --chart, tree file, outputs), # starts a comment line; seqdb and charts are loaded once for all jobs"}};
+    option<str>       serve{*this, "serve", desc{"listen on the unix domain socket for json job requests, see doc/tal-serve.org"}};
+    option<size_t>    jobs{*this, 'j', "jobs", dflt{0UL}, desc{"number of batch jobs (served requests) to run concurrently, 0 - number of hardware threads"}};
 
     option<bool>      interactive{*this, 'i', "interactive"};
     option<bool>      open{*this, "open"};
     option<bool>      ql{*this, "ql"};
     option<str_array> verbose{*this, 'v', "verbose", desc{"comma separated list (or multiple switches) of enablers"}};
 
-    argument<str> tree_file{*this, arg_name{"tree.newick|tree.phy|tree.json[.xz]|tjz"}, mandatory};
+    argument<str> tree_file{*this, arg_name{"tree.newick|tree.phy|tree.json[.xz]|tjz"}}; // mandatory unless --batch
     argument<str_array> outputs{*this, arg_name{".pdf, .json[.xz], .html, .names, /json, /names"}}; // , mandatory};
 
     // option<bool>      no_whocc{*this, "no-whocc", desc{"init settings without whocc defaults (clades, hz sections)"}};
@@ -50,7 +71,32 @@ struct Options : public argv
     // option<bool>      no_draw{*this, "no-draw", desc{"do not generate pdf"}};
 };
 
+// seqdb is global, trees and charts are imported once and shared by batch jobs and served requests
+struct caches_t
+{
+    acmacs::tal::FileCache<std::shared_ptr<const acmacs::tal::Tree>> trees{[](std::string_view filename) {
+        auto tree = std::make_shared<acmacs::tal::Tree>();
+        acmacs::tal::import_tree(filename, *tree);
+        return std::shared_ptr<const acmacs::tal::Tree>{std::move(tree)};
+    }};
+    acmacs::tal::FileCache<acmacs::chart::ChartP> charts{[](std::string_view filename) { return acmacs::chart::import_from_file(filename); }};
+};
+
+struct timing_t
+{
+    using duration_t = std::chrono::duration<double>;
+    duration_t import{0}, apply{0}, prepare{0}, output{0};
+};
+
 static void signal_handler(int sig_num);
+static void process(acmacs::tal::Tal& tal, acmacs::tal::Settings& settings, const Options& opt, timing_t& timing);
+static void load_settings(acmacs::tal::Settings& settings, const Options& opt);
+static void run_job(const std::vector<std::string>& args, caches_t& caches, timing_t& timing);
+static int interactive(acmacs::tal::Tal& tal, acmacs::tal::Settings& settings, const Options& opt);
+static int batch(const Options& opt);
+static void profile_start(const Options& opt);
+static void profile_report(const Options& opt);
+static std::string serve_request(std::string_view request_text, caches_t& caches);
 
 int main(int argc, const char* argv[])
 {
@@ -63,84 +109,175 @@ int main(int argc, const char* argv[])
         acmacs::log::enable(opt.verbose);
         acmacs::log::enable(acmacs::log::hz_sections);
 
+        if ((opt.batch || opt.serve) && (acmacs::log::is_enabled(acmacs::log::profile) || opt.profile_json))
+            throw std::runtime_error{"profiling (-v profile, --profile-json) is not supported with --batch and --serve"};
+        if (opt.batch)
+            return batch(opt);
+        if (opt.serve) {
+            acmacs::seqdb::get(); // load seqdb before serving
+            acmacs::tal::seqdb_setup_fixed();
+            caches_t caches;
+            acmacs::tal::serve(opt.serve, opt.jobs, [&caches](std::string_view request) { return serve_request(request, caches); });
+            return 0;
+        }
+        if (std::string_view{opt.tree_file}.empty())
+            throw std::runtime_error{"tree file not specified"};
+
         acmacs::tal::Tal tal;
         // tal.import_tree(opt.tree_file);
         tal.import_chart(opt.chart_file);
 
         acmacs::tal::Settings settings{tal};
-        settings.load_from_conf({"tal.json"sv, "vaccines.json"sv});
-        settings.load(opt.settings_files);
-        settings.set_defines(opt.defines);
+        load_settings(settings, opt);
 
         if (opt.interactive)
-            signal(SIGHUP, signal_handler);
-
-        for (;;) {
-            tal.import_tree(opt.tree_file);
-            settings.update_env();
-
-            AD_INFO("applying \"tal-default\"...");
-            const Timeit time_tal_default("applying \"tal-default\"");
-            settings.apply("tal-default"sv);
-            time_tal_default.report();
-
-            if (opt.chart_file) {
-                acmacs::tal::AntigenicMaps* maps{tal.draw().layout().find<acmacs::tal::AntigenicMaps>()};
-                if (!maps)
-                    throw std::runtime_error{"internal: AntigenicMaps not found in layout"};
-                acmacs::tal::MapsSettings& maps_settings{maps->maps_settings()};
-                maps_settings.load_from_conf({"mapi.json"sv, "tal.json"sv, "clades.json"sv, "vaccines.json"sv});
-                maps_settings.load(opt.settings_files);
-                maps_settings.set_defines(opt.defines);
-            }
+            return interactive(tal, settings, opt);
 
-            AD_INFO("preparing...");
-            const Timeit time_preparing("preparing");
-            tal.prepare();
-            time_preparing.report();
-
-            if (opt.first_last_leaves.has_value())
-                tal.tree().report_first_last_leaves(opt.first_last_leaves);
-
-            // Timeit time_exporting(">>>> exporting: ", report);
-            acmacs::tal::ExportOptions export_options{.add_aa_substitution_labels = *opt.export_aa_transion_labels};
-            for (const auto& output : *opt.outputs)
-                tal.export_tree(output, export_options);
-            // time_exporting.report();
-
-            if (opt.open || opt.ql) {
-                for (const auto& output : *opt.outputs) {
-                    if (acmacs::string::endswith(output, ".pdf"sv) || acmacs::string::endswith(output, ".html"sv) || acmacs::string::endswith(output, ".txt"sv) ||
-                        acmacs::string::endswith(output, ".text"sv))
-                        acmacs::open_or_quicklook(opt.open, opt.ql, output, 2);
-                }
-            }
+        tal.import_tree(opt.tree_file);
+        timing_t timing;
+        profile_start(opt);
+        process(tal, settings, opt, timing);
+        profile_report(opt);
 
-            if (!opt.interactive)
-                break;
+        // AD_INFO("tal configuration docs: {}/share/doc/tal-conf.org", acmacs::acmacsd_root());
 
-            // ----------------------------------------------------------------------
-            // interactive
+        return 0;
+    }
+    catch (std::exception& err) {
+        AD_ERROR("{}", err);
+        return 1;
+    }
+}
 
-            fmt::print(stderr, "tal-i >> ");
+// ----------------------------------------------------------------------
 
-            fd_set set;
-            FD_ZERO(&set);
-            FD_SET(0, &set);
-            if (select(FD_SETSIZE, &set, nullptr, nullptr, nullptr) > 0) {
-                std::string input(20, ' ');
-                if (const auto bytes = ::read(0, input.data(), input.size()); bytes > 0) {
-                    input.resize(static_cast<size_t>(bytes));
-                }
-            }
+void load_settings(acmacs::tal::Settings& settings, const Options& opt)
+{
+    using namespace std::string_view_literals;
+    settings.load_from_conf({"tal.json"sv, "vaccines.json"sv});
+    settings.load(opt.settings_files);
+    settings.set_defines(opt.defines);
+
+} // load_settings
 
-            acmacs::run_and_detach("tink");
+// ----------------------------------------------------------------------
+
+void process(acmacs::tal::Tal& tal, acmacs::tal::Settings& settings, const Options& opt, timing_t& timing)
+{
+    using namespace std::string_view_literals;
+    using clock = std::chrono::steady_clock;
+
+    settings.update_env();
+
+    const auto apply_start = clock::now();
+    AD_INFO("applying \"tal-default\"...");
+    const Timeit time_tal_default("applying \"tal-default\"");
+    settings.apply("tal-default"sv);
+    time_tal_default.report();
+
+    if (opt.chart_file) {
+        acmacs::tal::AntigenicMaps* maps{tal.draw().layout().find<acmacs::tal::AntigenicMaps>()};
+        if (!maps)
+            throw std::runtime_error{"internal: AntigenicMaps not found in layout"};
+        acmacs::tal::MapsSettings& maps_settings{maps->maps_settings()};
+        maps_settings.load_from_conf({"mapi.json"sv, "tal.json"sv, "clades.json"sv, "vaccines.json"sv});
+        maps_settings.load(opt.settings_files);
+        maps_settings.set_defines(opt.defines);
+    }
+
+    const auto prepare_start = clock::now();
+    timing.apply = prepare_start - apply_start;
+    AD_INFO("preparing...");
+    const Timeit time_preparing("preparing");
+    tal.prepare();
+    time_preparing.report();
+
+    if (opt.first_last_leaves.has_value())
+        tal.tree().report_first_last_leaves(opt.first_last_leaves);
+
+    const auto output_start = clock::now();
+    timing.prepare = output_start - prepare_start;
+    // Timeit time_exporting(">>>> exporting: ", report);
+    acmacs::tal::ExportOptions export_options{.add_aa_substitution_labels = *opt.export_aa_transion_labels, .compression_threads = *opt.compression_threads, .html_chunk_leaves = *opt.html_chunk_leaves};
+    tal.export_trees(*opt.outputs, export_options);
+    // time_exporting.report();
+    timing.output = clock::now() - output_start;
+
+    if (opt.open || opt.ql) {
+        for (const auto& output : *opt.outputs) {
+            if (acmacs::string::endswith(output, ".pdf"sv) || acmacs::string::endswith(output, ".html"sv) || acmacs::string::endswith(output, ".txt"sv) ||
+                acmacs::string::endswith(output, ".text"sv))
+                acmacs::open_or_quicklook(opt.open, opt.ql, output, 2);
+        }
+    }
+
+} // process
+
+// ----------------------------------------------------------------------
+
+// Profiling data are process wide, it is enabled for the single tal run (or for every re-run in interactive mode) but not for concurrent batch jobs and served requests
+void profile_start(const Options& opt)
+{
+    acmacs::tal::profile::enable(acmacs::log::is_enabled(acmacs::log::profile) || opt.profile_json);
+
+} // profile_start
 
-            fmt::print(stderr, "\n> {sep}\n> {date}\n> {sep}\n\n", fmt::arg("sep", "======================================================================================================================================================"),
-                       fmt::arg("date", date::current_date_time()));
-            tal.reset();
+// ----------------------------------------------------------------------
+
+void profile_report(const Options& opt)
+{
+    if (acmacs::tal::profile::enabled()) {
+        if (acmacs::log::is_enabled(acmacs::log::profile))
+            AD_INFO("profile:\n{}", acmacs::tal::profile::report_table());
+        if (opt.profile_json)
+            acmacs::file::write(*opt.profile_json, acmacs::tal::profile::report_json());
+        acmacs::tal::profile::enable(false);
+    }
+
+} // profile_report
+
+// ----------------------------------------------------------------------
+
+// Tree, chart and settings (-s) files are watched, outputs are re-exported when any of them changes:
+//  - tree: tree is imported again, settings are re-applied
+//  - chart: chart is imported again, settings are re-applied
+//  - settings: settings are re-applied to a copy of the already imported tree,
+//    aa transitions are not recalculated if neither tree nor their parameters changed (e.g. just drawing parameters were changed)
+// SIGHUP: import tree and chart again
+int interactive(acmacs::tal::Tal& tal, acmacs::tal::Settings& settings, const Options& opt)
+{
+    struct sigaction action{};
+    action.sa_handler = signal_handler; // no SA_RESTART, waiting for changes is interrupted
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGHUP, &action, nullptr);
+    acmacs::tal::enable_aa_transitions_cache(true);
+
+    acmacs::tal::FileWatch watch;
+    const auto tree_index = watch.add(opt.tree_file);
+    const auto chart_index = watch.add(opt.chart_file);
+    for (const auto& settings_file : *opt.settings_files)
+        watch.add(settings_file);
+
+    std::shared_ptr<const acmacs::tal::Tree> source_tree;
+    bool settings_loaded{true}, chart_changed{false};
+    for (;;) {
+        if (settings_loaded) {
             try {
-                settings.reload();
+                if (chart_changed) {
+                    chart_changed = false; // if importing fails, wait for the next change of the chart
+                    tal.import_chart(opt.chart_file);
+                }
+                if (!source_tree) {
+                    auto tree = std::make_shared<acmacs::tal::Tree>();
+                    acmacs::tal::import_tree(opt.tree_file, *tree);
+                    source_tree = std::move(tree);
+                }
+                tal.import_tree(source_tree);
+                timing_t timing;
+                profile_start(opt);
+                process(tal, settings, opt, timing);
+                profile_report(opt);
+                AD_INFO("tal-i: apply {:.3f}s prepare {:.3f}s output {:.3f}s", timing.apply.count(), timing.prepare.count(), timing.output.count());
             }
             catch (std::exception& err) {
                 AD_ERROR("{}", err);
@@ -148,15 +285,233 @@ int main(int argc, const char* argv[])
             }
         }
 
-        // AD_INFO("tal configuration docs: {}/share/doc/tal-conf.org", acmacs::acmacsd_root());
+        fmt::print(stderr, "tal-i >> waiting for changes\n");
+        const auto changed = watch.wait();
+        const auto is_changed = [&changed](size_t index) { return std::find(std::begin(changed), std::end(changed), index) != std::end(changed); };
+        if (changed.empty()) { // signal
+            AD_INFO("tal-i: importing tree and chart");
+            source_tree.reset();
+            chart_changed = true;
+        }
+        else {
+            if (is_changed(tree_index)) {
+                AD_INFO("tal-i: tree changed");
+                source_tree.reset();
+            }
+            if (is_changed(chart_index)) {
+                AD_INFO("tal-i: chart changed");
+                chart_changed = true;
+            }
+            if (!is_changed(tree_index) && !is_changed(chart_index))
+                AD_INFO("tal-i: settings changed");
+        }
 
-        return 0;
+        acmacs::run_and_detach("tink");
+
+        fmt::print(stderr, "\n> {sep}\n> {date}\n> {sep}\n\n", fmt::arg("sep", "======================================================================================================================================================"),
+                   fmt::arg("date", date::current_date_time()));
+        tal.reset();
+        try {
+            settings.reload();
+            settings_loaded = true;
+        }
+        catch (std::exception& err) {
+            AD_ERROR("{}", err);
+            acmacs::run_and_detach("submarine");
+            settings_loaded = false;
+        }
     }
-    catch (std::exception& err) {
-        AD_ERROR("{}", err);
+
+} // interactive
+
+// ----------------------------------------------------------------------
+
+// Every job is a separate Tal with its own settings, seqdb (set up in main, loaded and fixed by batch() and serving), trees and charts are shared.
+// args: tal command line arguments without program name
+void run_job(const std::vector<std::string>& args, caches_t& caches, timing_t& timing)
+{
+    std::vector<const char*> argv{"tal"};
+    std::transform(std::begin(args), std::end(args), std::back_inserter(argv), [](const auto& arg) { return arg.c_str(); });
+    const Options opt(static_cast<int>(argv.size()), argv.data(), on_error::raise);
+    if (std::string_view{opt.tree_file}.empty())
+        throw std::runtime_error{"tree file not specified"};
+    if (opt.profile_json)
+        throw std::runtime_error{"--profile-json is not supported in batch jobs and served requests"};
+
+    const auto import_start = std::chrono::steady_clock::now();
+    acmacs::tal::Tal tal;
+    tal.import_tree(caches.trees.get(opt.tree_file));
+    if (opt.chart_file)
+        tal.chart(caches.charts.get(opt.chart_file));
+    timing.import = std::chrono::steady_clock::now() - import_start;
+
+    acmacs::tal::Settings settings{tal};
+    load_settings(settings, opt);
+    process(tal, settings, opt, timing);
+
+} // run_job
+
+// ----------------------------------------------------------------------
+
+// A job failure is reported and does not stop other jobs.
+int batch(const Options& opt)
+{
+    struct job_t
+    {
+        size_t line_no;
+        std::vector<std::string> args;
+    };
+
+    const auto manifest = acmacs::file::read(opt.batch);
+    std::vector<job_t> jobs;
+    for (size_t line_no = 1; const auto line : acmacs::string::split(manifest, "\n")) {
+        if (const auto args = acmacs::string::split(line, " ", acmacs::string::Split::StripRemoveEmpty); !args.empty() && args.front().front() != '#')
+            jobs.push_back(job_t{line_no, std::vector<std::string>(std::begin(args), std::end(args))});
+        ++line_no;
+    }
+
+    acmacs::seqdb::get(); // load seqdb before starting workers
+    acmacs::tal::seqdb_setup_fixed();
+    caches_t caches;
+    std::atomic<size_t> failed{0};
+
+    const auto batch_name = fmt::format("batch of {} jobs", jobs.size());
+    const Timeit time_batch{batch_name};
+    acmacs::tal::parallel_for(
+        jobs.size(),
+        [&opt, &jobs, &caches, &failed](size_t job_no) {
+            const auto& job = jobs[job_no];
+            try {
+                const auto job_name = fmt::format("{}:{} job", opt.batch, job.line_no);
+                const Timeit time_job{job_name};
+                timing_t timing;
+                run_job(job.args, caches, timing);
+            }
+            catch (std::exception& err) {
+                AD_ERROR("{}:{}: {}", opt.batch, job.line_no, err);
+                ++failed;
+            }
+        },
+        opt.jobs);
+
+    if (failed > 0) {
+        AD_ERROR("{} of {} batch jobs failed", failed.load(), jobs.size());
         return 1;
     }
-}
+    return 0;
+
+} // batch
+
+// ----------------------------------------------------------------------
+
+static std::string json_string(std::string_view source)
+{
+    std::string result{"\""};
+    for (const char cc : source) {
+        switch (cc) {
+            case '"':
+            case '\\':
+                result.append({'\\', cc});
+                break;
+            case '\n':
+                result.append("\\n");
+                break;
+            default:
+                if (static_cast<unsigned char>(cc) < 0x20)
+                    result.append(fmt::format("\\u{:04x}", static_cast<unsigned>(cc)));
+                else
+                    result.push_back(cc);
+                break;
+        }
+    }
+    result.push_back('"');
+    return result;
+
+} // json_string
+
+// ----------------------------------------------------------------------
+
+// request: {"tree": "tree.json.xz", "settings": ["s.json"], "defines": ["name=value"], "chart": "chart.ace", "outputs": ["out.pdf"], "pdf": true}
+// reply: a json line {"status": "ok", "outputs": [...], "timing": {...}, "pdf_size": N} followed by N bytes of the pdf if requested
+// or {"status": "error", "error": "message", "timing": {...}}
+std::string serve_request(std::string_view request_text, caches_t& caches)
+{
+    using namespace std::string_view_literals;
+
+    static std::atomic<size_t> request_no{0};
+    const auto start = std::chrono::steady_clock::now();
+    timing_t timing;
+    std::vector<std::string> outputs;
+    std::string pdf_data;
+    std::string error;
+    fs::path temp_pdf;
+
+    try {
+        const auto request = rjson::v3::parse_string(request_text);
+        std::vector<std::string> args;
+        const auto strings = [](const rjson::v3::value& source) {
+            std::vector<std::string> result;
+            if (source.is_string())
+                result.emplace_back(source.to<std::string_view>());
+            else if (source.is_array()) {
+                for (const auto& en : source.array())
+                    result.emplace_back(en.to<std::string_view>());
+            }
+            return result;
+        };
+        for (const auto& settings_file : strings(request["settings"sv]))
+            args.insert(args.end(), {"-s", settings_file});
+        for (const auto& define : strings(request["defines"sv]))
+            args.insert(args.end(), {"-D", define});
+        for (const auto& chart : strings(request["chart"sv]))
+            args.insert(args.end(), {"--chart", chart});
+        const auto tree = strings(request["tree"sv]);
+        if (tree.size() != 1)
+            throw std::runtime_error{"single \"tree\" expected in the request"};
+        args.push_back(tree.front());
+        outputs = strings(request["outputs"sv]);
+
+        const bool reply_pdf = rjson::v3::read_bool(request["pdf"sv], false);
+        auto pdf = std::find_if(std::begin(outputs), std::end(outputs), [](std::string_view output) { return fs::path{output}.extension() == ".pdf"; });
+        if (reply_pdf && pdf == std::end(outputs)) {
+            temp_pdf = fs::temp_directory_path() / fmt::format("tal-serve-{}-{}.pdf", ::getpid(), ++request_no);
+            args.push_back(temp_pdf.string());
+        }
+        args.insert(args.end(), std::begin(outputs), std::end(outputs));
+
+        run_job(args, caches, timing);
+        if (reply_pdf)
+            pdf_data = acmacs::file::read(temp_pdf.empty() ? std::string_view{*pdf} : std::string_view{temp_pdf.native()});
+    }
+    catch (std::exception& err) {
+        error = fmt::format("{}", err);
+        AD_ERROR("serve: {}", error);
+    }
+    if (!temp_pdf.empty()) {
+        std::error_code ec;
+        fs::remove(temp_pdf, ec);
+    }
+
+    const std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+    std::string reply{R"({"status": ")"};
+    if (!error.empty())
+        reply.append(fmt::format(R"(error", "error": {})", json_string(error)));
+    else {
+        reply.append(R"(ok")");
+        std::vector<std::string> quoted(outputs.size());
+        std::transform(std::begin(outputs), std::end(outputs), std::begin(quoted), json_string);
+        reply.append(fmt::format(R"(, "outputs": [{}])", fmt::join(quoted, ", ")));
+        if (!pdf_data.empty())
+            reply.append(fmt::format(R"(, "pdf_size": {})", pdf_data.size()));
+    }
+    reply.append(fmt::format(R"(, "timing": {{"total": {:.3f}, "import": {:.3f}, "apply": {:.3f}, "prepare": {:.3f}, "output": {:.3f}}}}})", total.count(), timing.import.count(), timing.apply.count(),
+                             timing.prepare.count(), timing.output.count()));
+    reply.push_back('\n');
+    reply.append(pdf_data);
+    AD_INFO("serve: {:.3f}s {}", total.count(), error.empty() ? "ok"sv : "error"sv);
+    return reply;
+
+} // serve_request
 
 // ----------------------------------------------------------------------
 
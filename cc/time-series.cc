@@ -5,6 +5,7 @@
 #include "acmacs-tal/tal-data.hh"
 #include "acmacs-tal/draw-tree.hh"
 #include "acmacs-tal/tree-iterate.hh"
+#include "acmacs-tal/leaf-attributes.hh"
 #include "acmacs-tal/log.hh"
 #include "acmacs-tal/settings.hh"
 
@@ -15,7 +16,7 @@ void acmacs::tal::v3::TimeSeries::prepare(preparation_stage_t stage)
     using namespace std::string_view_literals;
 
     if (stage == 1 && prepared_ < stage) {
-        tal().draw().layout().prepare_element<DrawTree>(stage);
+        require(artifact_t::node_ids);
 
         const auto ts_stat = acmacs::time_series::stat(parameters().time_series, tal().tree().all_dates());
         const auto [first, after_last] = acmacs::time_series::suggest_start_end(parameters().time_series, ts_stat);
@@ -40,7 +41,7 @@ void acmacs::tal::v3::TimeSeries::prepare(preparation_stage_t stage)
         tal().settings().setenv("time-series-range"sv, acmacs::time_series::range_name(parameters().time_series, series_, "-"));
     }
     else if (stage == 3 && prepared_ < stage) {
-        tal().draw().layout().prepare_element<DrawTree>(stage);
+        require(artifact_t::vertical_offsets);
         prepare_dashes();
     }
     LayoutElementWithColoring::prepare(stage);
@@ -49,6 +50,19 @@ void acmacs::tal::v3::TimeSeries::prepare(preparation_stage_t stage)
 
 // ----------------------------------------------------------------------
 
+bool acmacs::tal::v3::TimeSeries::concurrent_prepare(preparation_stage_t stage)
+{
+    if (stage != 3 || prepared_ >= stage)
+        return false;
+    // dashes are made from vertical offsets and leaf attributes, both computed here before concurrent preparation
+    require(artifact_t::vertical_offsets);
+    tal().tree().leaf_attributes();
+    return true;
+
+} // acmacs::tal::v3::TimeSeries::concurrent_prepare
+
+// ----------------------------------------------------------------------
+
 void acmacs::tal::v3::TimeSeries::set_width_to_height_ratio()
 {
     if (width_to_height_ratio() <= 0.0)
@@ -67,10 +81,11 @@ void acmacs::tal::v3::TimeSeries::prepare_dashes()
         AD_LOG(acmacs::log::time_series, "    {:2d} {} - {}", slot_no, series_[slot_no].first, series_[slot_no].after_last);
 
     dashes_.clear();
-    tree::iterate_leaf(tal().tree(), [this](const Node& leaf) {
+    const auto attributes = tal().tree().leaf_attributes();
+    tree::iterate_leaf(tal().tree(), [this, &attributes](const Node& leaf) {
         if (!leaf.hidden && !leaf.date.empty()) {
             try {
-                auto leaf_date = date::from_string(leaf.date, date::allow_incomplete::yes, date::throw_on_error::yes);
+                auto leaf_date = attributes->year_month_day(leaf);
                 if (date::get_month(leaf_date) == 0)
                     date::increment_month(leaf_date, 6);
                 if (date::get_day(leaf_date) == 0)
@@ -125,6 +140,7 @@ void acmacs::tal::v3::TimeSeries::prepare_dash(size_t slot_no, const Node& leaf)
 
 void acmacs::tal::v3::TimeSeries::prepare_coloring()
 {
+    coloring().leaf_attributes(tal().tree().leaf_attributes());
     tree::iterate_leaf(tal().tree(), [this](const Node& leaf) {
         if (!leaf.hidden && !leaf.date.empty())
             coloring().prepare(leaf);
@@ -366,6 +382,9 @@ void acmacs::tal::v3::TimeSeriesWithShift::set_width_to_height_ratio()
 
 void acmacs::tal::v3::TimeSeriesWithShift::prepare_coloring()
 {
+    const auto attributes = tal().tree().leaf_attributes();
+    for (auto& coloring : coloring_)
+        coloring->leaf_attributes(attributes);
     tree::iterate_leaf(tal().tree(), [this](const Node& leaf) {
         if (!leaf.hidden && !leaf.date.empty()) {
             for (auto& coloring : coloring_)
@@ -17,6 +17,7 @@ namespace acmacs::tal::inline v3
         TimeSeries(Tal& tal) : LayoutElementWithColoring(tal, 0.0) {}
 
         void prepare(preparation_stage_t stage) override;
+        bool concurrent_prepare(preparation_stage_t stage) override;
         void draw(acmacs::surface::Surface& surface) const override;
 
         void add_horizontal_line_above(const Node* node, const parameters::Line& line, bool warn_if_present);
@@ -1,17 +1,32 @@
 #pragma once
 
+#include <type_traits>
+
 #include "acmacs-base/enumerate.hh"
 #include "acmacs-base/fmt.hh"
+#include "acmacs-tal/profile.hh"
 
 // ----------------------------------------------------------------------
 
+namespace acmacs::tal::inline v3
+{
+    class Tree;
+}
+
 namespace acmacs::tal::inline v3::tree
 {
+    // iterations started at the tree root are counted for profiling, recursive calls are for Node
+    template <typename N> inline void count_traversal()
+    {
+        if constexpr (std::is_same_v<std::decay_t<N>, Tree>)
+            profile::tree_traversal();
+    }
 
     // ----------------------------------------------------------------------
 
     template <typename N, typename F1> inline void iterate_leaf(N&& node, F1 f_name)
     {
+        count_traversal<N>();
         if (node.is_leaf()) {
             f_name(std::forward<N>(node));
         }
@@ -23,6 +38,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F1> inline void iterate_leaf_path(N&& node, F1 f_name, std::vector<size_t>& path)
     {
+        count_traversal<N>();
         if (node.is_leaf()) {
             f_name(std::forward<N>(node), path);
         }
@@ -47,6 +63,7 @@ namespace acmacs::tal::inline v3::tree
     // stops iterating if f_name returns true
     template <typename N, typename F1> inline bool iterate_leaf_stop(N&& node, F1 f_name)
     {
+        count_traversal<N>();
         bool stop = false;
         if (node.is_leaf()) {
             stop = f_name(std::forward<N>(node));
@@ -64,6 +81,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F1, typename F3> inline void iterate_leaf_post(N&& node, F1 f_name, F3 f_subtree_post)
     {
+        count_traversal<N>();
         if (node.is_leaf()) {
             f_name(std::forward<N>(node));
         }
@@ -78,6 +96,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F1, typename F2> inline void iterate_leaf_pre(N&& node, F1 f_name, F2 f_subtree_pre)
     {
+        count_traversal<N>();
         if (node.is_leaf()) {
             f_name(std::forward<N>(node));
         }
@@ -93,6 +112,7 @@ namespace acmacs::tal::inline v3::tree
     // Stop descending the tree if f_subtree_pre returned false
     template <typename N, typename F1, typename F2> inline void iterate_leaf_pre_stop(N&& node, F1 f_name, F2 f_subtree_pre)
     {
+        count_traversal<N>();
         if (node.is_leaf()) {
             f_name(std::forward<N>(node));
         }
@@ -108,6 +128,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F3> inline void iterate_pre(N&& node, F3 f_subtree_pre)
     {
+        count_traversal<N>();
         if (!node.is_leaf()) {
             f_subtree_pre(std::forward<N>(node));
             for (auto& subnode : node.subtree)
@@ -118,6 +139,7 @@ namespace acmacs::tal::inline v3::tree
     // Stop descending the tree if f_subtree_pre returned false
     template <typename N, typename F3> inline void iterate_pre_stop(N&& node, F3 f_subtree_pre)
     {
+        count_traversal<N>();
         if (!node.is_leaf()) {
             if (f_subtree_pre(std::forward<N>(node))) {
                 for (auto& subnode : node.subtree)
@@ -139,6 +161,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename P, typename F1> inline void iterate_pre_parent(N&& node, P&& parent, F1 f_subtree_pre)
     {
+        count_traversal<N>();
         if (!node.is_leaf()) {
             f_subtree_pre(std::forward<N>(node), std::forward<P>(parent));
             for (auto& subnode : node.subtree)
@@ -148,6 +171,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F1> inline void iterate_pre_parent(N&& node, F1 f_subtree_pre)
     {
+        count_traversal<N>();
         if (!node.is_leaf()) {
             for (auto& subnode : node.subtree)
                 iterate_pre_parent(subnode, std::forward<N>(node), f_subtree_pre);
@@ -176,6 +200,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F3> inline void iterate_pre_path(N&& node, F3 f_subtree_pre, std::string path = std::string{})
     {
+        count_traversal<N>();
         if (!node.is_leaf()) {
             f_subtree_pre(std::forward<N>(node), path);
             for (auto [no, subnode] : acmacs::enumerate(node.subtree)) {
@@ -188,6 +213,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F3> inline void iterate_post(N&& node, F3 f_subtree_post)
     {
+        count_traversal<N>();
         if (!node.is_leaf()) {
             for (auto& subnode : node.subtree)
                 iterate_post(subnode, f_subtree_post);
@@ -199,6 +225,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F1, typename F2, typename F3> inline void iterate_leaf_pre_post(N&& node, F1 f_leaf, F2 f_subtree_pre, F3 f_subtree_post)
     {
+        count_traversal<N>();
         if (node.is_leaf()) {
             f_leaf(std::forward<N>(node));
         }
@@ -212,6 +239,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F1, typename F2, typename F3, typename F4> inline void iterate_stop_leaf_pre_post(N&& node, F1 f_stop, F2 f_leaf, F3 f_subtree_pre, F4 f_subtree_post)
     {
+        count_traversal<N>();
         if (!f_stop(std::forward<N>(node))) {
             if (node.is_leaf()) {
                 f_leaf(std::forward<N>(node));
@@ -229,6 +257,7 @@ namespace acmacs::tal::inline v3::tree
 
     template <typename N, typename F1, typename F2> inline void iterate_pre_post(N&& node, F1 f_subtree_pre, F2 f_subtree_post)
     {
+        count_traversal<N>();
         if (!node.is_leaf()) {
             f_subtree_pre(std::forward<N>(node));
             for (auto& subnode : node.subtree)
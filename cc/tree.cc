@@ -2,6 +2,12 @@
 #include <set>
 #include <unordered_map>
 #include <stack>
+#include <deque>
+#include <mutex>
+#include <functional>
+#include <shared_mutex>
+#include <bit>
+#include <numeric>
 
 #include "acmacs-base/statistics.hh"
 #include "acmacs-base/timeit.hh"
@@ -16,6 +22,60 @@
 #include "acmacs-tal/tree.hh"
 #include "acmacs-tal/tree-iterate.hh"
 #include "acmacs-tal/draw-tree.hh"
+#include "acmacs-tal/seqdb-population.hh"
+#include "acmacs-tal/seq-id-matcher.hh"
+#include "acmacs-tal/leaf-attributes.hh"
+#include "acmacs-tal/parallel.hh"
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    struct clade_names_t
+    {
+        std::shared_mutex access;
+        acmacs::tal::StringIds ids;
+    };
+
+    inline clade_names_t& clade_names()
+    {
+        static clade_names_t names;
+        return names;
+    }
+
+} // namespace
+
+acmacs::tal::v3::leaf_clades_t::id_t acmacs::tal::v3::leaf_clades_t::id(std::string_view name)
+{
+    if (const auto found = find(name); found != not_found)
+        return found;
+    auto& names = clade_names();
+    std::unique_lock lock{names.access};
+    const auto added = names.ids.id(name);
+    if (added >= not_found)
+        throw error(fmt::format("too many clade names, cannot add \"{}\"", name));
+    return static_cast<id_t>(added);
+
+} // acmacs::tal::v3::leaf_clades_t::id
+
+acmacs::tal::v3::leaf_clades_t::id_t acmacs::tal::v3::leaf_clades_t::find(std::string_view name)
+{
+    auto& names = clade_names();
+    std::shared_lock lock{names.access};
+    if (const auto found = names.ids.find(name); found != StringIds::not_found)
+        return static_cast<id_t>(found);
+    else
+        return not_found;
+
+} // acmacs::tal::v3::leaf_clades_t::find
+
+std::string_view acmacs::tal::v3::leaf_clades_t::name(id_t id)
+{
+    auto& names = clade_names();
+    std::shared_lock lock{names.access};
+    return names.ids[id]; // strings of StringIds are not moved when new ones are added
+
+} // acmacs::tal::v3::leaf_clades_t::name
 
 // ----------------------------------------------------------------------
 
@@ -70,7 +130,6 @@ std::vector<const acmacs::tal::v3::Node*> acmacs::tal::v3::Node::shown_children(
 void acmacs::tal::v3::Tree::erase()
 {
     *this = Tree();
-    // data_buffer_.erase();
 
 } // acmacs::tal::v3::Tree::erase
 
@@ -78,7 +137,7 @@ void acmacs::tal::v3::Tree::erase()
 
 void acmacs::tal::v3::Tree::cumulative_calculate(bool recalculate) const
 {
-    if (recalculate || cumulative_edge_length == EdgeLengthNotSet) {
+    if (recalculate || cumulative_edge_length == EdgeLengthNotSet || artifacts_.dirty(artifact_t::cumulative_lengths)) {
         Timeit time1(">>>> cumulative_calculate: ", report_time::no);
         EdgeLength cumulative{0.0};
         const auto leaf = [&cumulative](const Node& node) { node.cumulative_edge_length = cumulative + node.edge_length; };
@@ -89,6 +148,7 @@ void acmacs::tal::v3::Tree::cumulative_calculate(bool recalculate) const
         const auto post = [&cumulative](const Node& node) { cumulative -= node.edge_length; };
 
         tree::iterate_leaf_pre_post(*this, leaf, pre, post);
+        artifacts_.computed(artifact_t::cumulative_lengths);
     }
 
 } // acmacs::tal::v3::Tree::cumulative_calculate
@@ -325,6 +385,30 @@ void acmacs::tal::v3::Tree::branches_by_cumulative_edge()
 
 // ----------------------------------------------------------------------
 
+std::shared_ptr<const acmacs::tal::v3::LeafAttributes> acmacs::tal::v3::Tree::leaf_attributes() const
+{
+    static std::mutex making;
+    std::unique_lock lock{making};
+    if (!leaf_attributes_)
+        leaf_attributes_ = std::make_shared<const LeafAttributes>(*this);
+    return leaf_attributes_;
+
+} // acmacs::tal::v3::Tree::leaf_attributes
+
+// ----------------------------------------------------------------------
+
+acmacs::tal::v3::NodeIndex::NodeIndex(Node& root)
+{
+    const auto add = [this](Node& node) {
+        node.set_index_ = nodes_.size();
+        nodes_.push_back(&node);
+    };
+    tree::iterate_leaf_pre(root, add, add);
+
+} // acmacs::tal::v3::NodeIndex::NodeIndex
+
+// ----------------------------------------------------------------------
+
 template <typename F> inline void select_update(acmacs::tal::v3::NodeSet& nodes, acmacs::tal::v3::Tree::Select update, acmacs::tal::v3::Tree::Descent descent, acmacs::tal::v3::Node& root, F func)
 {
     using namespace acmacs::tal::v3;
@@ -388,32 +472,36 @@ void acmacs::tal::v3::Tree::select_intermediate(NodeSet& nodes, Select update, s
 
 void acmacs::tal::v3::Tree::select_by_date(NodeSet& nodes, Select update, std::string_view start, std::string_view end)
 {
-    select_update(nodes, update, Descent::yes, *this, [start,end](const Node& node) { return node.is_leaf() && !node.hidden && (start.empty() || node.date >= start) && (end.empty() || node.date < end); });
+    const auto attributes = leaf_attributes();
+    select_update(nodes, update, Descent::yes, *this, [&attributes, range = LeafDateRange{start, end}](const Node& node) { return node.is_leaf() && !node.hidden && range.contains(*attributes, node); });
 
 } // acmacs::tal::v3::Tree::select_by_date
 
 void acmacs::tal::v3::Tree::select_by_seq_id(NodeSet& nodes, Select update, std::string_view regexp)
 {
-    std::regex re{std::begin(regexp), std::end(regexp), std::regex_constants::ECMAScript|std::regex_constants::icase|std::regex_constants::optimize};
-    select_update(nodes, update, Descent::yes, *this, [&re](const Node& node) { return node.is_leaf() && !node.hidden && std::regex_search(node.seq_id->begin(), node.seq_id->end(), re); });
+    const auto matcher = seq_id_matcher({std::string{regexp}});
+    select_update(nodes, update, Descent::yes, *this, [&matcher](const Node& node) { return node.is_leaf() && !node.hidden && matcher->matches_any(*node.seq_id); });
 }
 
 void acmacs::tal::v3::Tree::select_by_country(NodeSet& nodes, Select update, std::string_view country_to_select)
 {
-    select_update(nodes, update, Descent::yes, *this, [country_to_select](const Node& node) { return node.is_leaf() && !node.hidden && node.country == country_to_select; });
+    const auto attributes = leaf_attributes();
+    select_update(nodes, update, Descent::yes, *this, [&attributes, country_id = attributes->countries().find(country_to_select)](const Node& node) { return node.is_leaf() && !node.hidden && attributes->country(node) == country_id; });
 
 } // acmacs::tal::v3::Tree::select_by_country
 
 void acmacs::tal::v3::Tree::select_by_continent(NodeSet& nodes, Select update, std::string_view continent_to_select)
 {
-    select_update(nodes, update, Descent::yes, *this, [continent_to_select](const Node& node) { return node.is_leaf() && !node.hidden && node.continent == continent_to_select; });
+    const auto attributes = leaf_attributes();
+    select_update(nodes, update, Descent::yes, *this, [&attributes, continent_id = attributes->continents().find(continent_to_select)](const Node& node) { return node.is_leaf() && !node.hidden && attributes->continent(node) == continent_id; });
 
 } // acmacs::tal::v3::Tree::select_by_continent
 
 void acmacs::tal::v3::Tree::select_by_location(NodeSet& nodes, Select update, std::string_view location)
 {
-    select_update(nodes, update, Descent::yes, *this, [location](const Node& node) {
-        return node.is_leaf() && !node.hidden && !node.strain_name.empty() && ::virus_name::location(acmacs::virus::v2::name_t{node.strain_name}) == location;
+    const auto attributes = leaf_attributes();
+    select_update(nodes, update, Descent::yes, *this, [&attributes, location_id = attributes->locations().find(location)](const Node& node) {
+        return node.is_leaf() && !node.hidden && !node.strain_name.empty() && attributes->location(node) == location_id;
     });
 
 } // acmacs::tal::v3::Tree::select_by_location
@@ -433,28 +521,31 @@ void acmacs::tal::v3::Tree::select_matches_chart_antigens(NodeSet& nodes, Select
     select_update(nodes, update, Descent::yes, *this, [](const Node& node) { return node.is_leaf() && node.antigen_index_in_chart_.has_value(); });
 }
 
-void acmacs::tal::v3::Tree::select_matches_chart_sera(NodeSet& nodes, Select update, serum_match_t match_type)
+bool acmacs::tal::v3::Tree::matches_chart_serum(const Node& node, serum_match_t match_type)
 {
-    const auto serum_matches = [match_type](const Node& node) -> bool {
-        if (!node.is_leaf())
-            return false;
-        for (const auto& serum_data : node.serum_index_in_chart_) {
-            switch (match_type) {
-              case serum_match_t::name:
+    if (!node.is_leaf())
+        return false;
+    for (const auto& serum_data : node.serum_index_in_chart_) {
+        switch (match_type) {
+          case serum_match_t::name:
+              return true;
+          case serum_match_t::reassortant:
+              if (serum_data.reassortant_matches)
                   return true;
-              case serum_match_t::reassortant:
-                  if (serum_data.reassortant_matches)
-                      return true;
-                  break;
-              case serum_match_t::passage_type:
-                  if (serum_data.reassortant_matches && serum_data.passage_type_matches)
-                      return true;
-                  break;
-            }
+              break;
+          case serum_match_t::passage_type:
+              if (serum_data.reassortant_matches && serum_data.passage_type_matches)
+                  return true;
+              break;
         }
-        return false;
-    };
-    select_update(nodes, update, Descent::yes, *this, serum_matches);
+    }
+    return false;
+
+} // acmacs::tal::v3::Tree::matches_chart_serum
+
+void acmacs::tal::v3::Tree::select_matches_chart_sera(NodeSet& nodes, Select update, serum_match_t match_type)
+{
+    select_update(nodes, update, Descent::yes, *this, [match_type](const Node& node) { return matches_chart_serum(node, match_type); });
 }
 
 acmacs::chart::PointIndexList acmacs::tal::v3::Tree::chart_antigens_in_tree() const
@@ -533,11 +624,11 @@ acmacs::chart::PointIndexList acmacs::tal::v3::Tree::chart_sera_in_section(const
 
 // ----------------------------------------------------------------------
 
-void acmacs::tal::v3::Tree::select_by_top_cumulative_gap(NodeSet& nodes, Select update, double top_gap_rel)
+std::optional<double> acmacs::tal::v3::Tree::top_cumulative_gap_cut_off(double top_gap_rel) const
 {
     if (top_gap_rel <= 1.0) {
         AD_WARNING("invalid value for \"top-cumulative-gap\": {}, must be >1.0, node selection criterium ignored", top_gap_rel);
-        return;
+        return std::nullopt;
     }
 
     if (const std::vector<const Node*> sorted = sorted_by_cumulative_edge(leaves_only::no); sorted.size() > 10) {
@@ -553,12 +644,20 @@ void acmacs::tal::v3::Tree::select_by_top_cumulative_gap(NodeSet& nodes, Select
                     break;
                 }
             }
-            select_if_cumulative_more_than(nodes, update, cut_off_cumulative_edge, Descent::no);
             AD_INFO("\"top-cumulative-gap\": {}: cut_off_gaps: {:.8f}  cut_off_cumulative_edge: {:.8f}", top_gap_rel, cumulative_gaps[0], cut_off_cumulative_edge);
+            return cut_off_cumulative_edge;
         }
         else
             AD_INFO("\"top-cumulative-gap\" not applied, ratio of top cumul gaps: {} <= {}", cumulative_gaps[0] / cumulative_gaps[1], top_gap_rel);
     }
+    return std::nullopt;
+
+} // acmacs::tal::v3::Tree::top_cumulative_gap_cut_off
+
+void acmacs::tal::v3::Tree::select_by_top_cumulative_gap(NodeSet& nodes, Select update, double top_gap_rel)
+{
+    if (const auto cut_off_cumulative_edge = top_cumulative_gap_cut_off(top_gap_rel); cut_off_cumulative_edge.has_value())
+        select_if_cumulative_more_than(nodes, update, *cut_off_cumulative_edge, Descent::no);
 
 } // acmacs::tal::v3::Tree::select_by_top_cumulative_gap
 
@@ -606,26 +705,61 @@ void acmacs::tal::v3::Tree::hide(const NodeSet& nodes, hide_if_too_many_leaves f
 
 void acmacs::tal::v3::Tree::match_seqdb(std::string_view seqdb_filename)
 {
-    acmacs::seqdb::setup(seqdb_filename);
-    const auto& seqdb = acmacs::seqdb::get();
+    clades_evaluate(); // with the current sequences
+    leaf_attributes_.reset();
+    artifacts_.invalidate(artifact_t::sequences);
+    seqdb_setup(seqdb_filename);
+    auto& population = seqdb_population();
+
+    std::vector<Node*> leaves;
+    tree::iterate_leaf(*this, [&leaves](Node& node) { leaves.push_back(&node); });
+
+    // leaves are looked up and populated in parallel chunks, leaves missing in the population snapshot are collected per chunk,
+    // resolved against seqdb and populated in the second pass
+    constexpr const size_t chunk_size{1024};
+    auto index = population.snapshot();
+    std::vector<std::vector<size_t>> missing_per_chunk((leaves.size() + chunk_size - 1) / chunk_size);
+    parallel_for_chunks(leaves.size(), chunk_size, [&leaves, &index, &missing_per_chunk](size_t first, size_t last) {
+        auto& missing = missing_per_chunk[first / chunk_size];
+        for (size_t no = first; no < last; ++no) {
+            if (const auto found = index->find(*leaves[no]->seq_id); found == index->end())
+                missing.push_back(no);
+            else if (found->second)
+                leaves[no]->populate(*found->second);
+        }
+    });
 
+    std::vector<size_t> missing;
+    for (const auto& chunk : missing_per_chunk)
+        missing.insert(std::end(missing), std::begin(chunk), std::end(chunk));
+    if (!missing.empty()) {
+        std::vector<std::string> seq_ids(missing.size());
+        std::transform(std::begin(missing), std::end(missing), std::begin(seq_ids), [&leaves](size_t no) { return *leaves[no]->seq_id; });
+        index = population.add(std::move(seq_ids));
+        parallel_for_chunks(missing.size(), chunk_size, [&leaves, &index, &missing](size_t first, size_t last) {
+            for (size_t no = first; no < last; ++no) {
+                if (const auto* data = index->find(*leaves[missing[no]]->seq_id)->second; data)
+                    leaves[missing[no]]->populate(*data);
+            }
+        });
+    }
+
+    // reduction in the leaf order, warnings and not found report are the same for every run
     std::vector<seq_id_t> not_found;
-    tree::iterate_leaf(*this, [this, &seqdb, &not_found](Node& node) {
-        if (const auto subset = seqdb.select_by_seq_id(node.seq_id); !subset.empty()) {
-            node.populate(subset.front(), seqdb);
+    for (const auto* leaf : leaves) {
+        if (!leaf->ref.empty()) {
             if (virus_type_.empty())
-                virus_type_ = node.ref.entry->virus_type;
-            else if (virus_type_ != node.ref.entry->virus_type)
-                AD_WARNING("multiple virus_types from seqdb for \"{}\": {} and {}", node.seq_id, virus_type_, node.ref.entry->virus_type);
+                virus_type_ = leaf->ref.entry->virus_type;
+            else if (virus_type_ != leaf->ref.entry->virus_type)
+                AD_WARNING("multiple virus_types from seqdb for \"{}\": {} and {}", leaf->seq_id, virus_type_, leaf->ref.entry->virus_type);
             if (lineage_.empty())
-                lineage_ = node.ref.entry->lineage;
-            else if (lineage_ != node.ref.entry->lineage && !node.ref.entry->lineage.empty())
-                AD_WARNING("multiple lineages from seqdb for \"{}\": {} and {}", node.seq_id, lineage_, node.ref.entry->lineage);
+                lineage_ = leaf->ref.entry->lineage;
+            else if (lineage_ != leaf->ref.entry->lineage && !leaf->ref.entry->lineage.empty())
+                AD_WARNING("multiple lineages from seqdb for \"{}\": {} and {}", leaf->seq_id, lineage_, leaf->ref.entry->lineage);
         }
-        else {
-            not_found.push_back(node.seq_id);
-        }
-    });
+        else
+            not_found.push_back(leaf->seq_id);
+    }
 
     if (!not_found.empty()) {
         constexpr const size_t threshold{10};
@@ -649,52 +783,102 @@ void acmacs::tal::v3::Node::populate(const acmacs::seqdb::ref& a_ref, const acma
     strain_name = ref.entry->name;
     continent = ref.entry->continent;
     country = ref.entry->country;
-    hi_names = ref.seq().hi_names;
-    gisaid = ref.seq().gisaid;
+    seqdb_hi_names_ = &ref.seq().hi_names;
+    seqdb_gisaid_ = &ref.seq().gisaid;
 
 } // acmacs::tal::v3::Node::populate
 
 // ----------------------------------------------------------------------
 
-void acmacs::tal::v3::Tree::populate_with_nuc_duplicates()
+void acmacs::tal::v3::Node::populate(const seqdb_leaf_data_t& data)
 {
-    std::vector<seq_id_t> all_seq_ids;
-    tree::iterate_leaf(*this, [&all_seq_ids](const Node& node) { all_seq_ids.push_back(node.seq_id); });
-    std::sort(std::begin(all_seq_ids), std::end(all_seq_ids));
-    const auto already_in_tree = [&all_seq_ids](const seq_id_t& look_for) {
-        const auto found = std::lower_bound(std::begin(all_seq_ids), std::end(all_seq_ids), look_for);
-        return found != std::end(all_seq_ids) && *found == look_for;
-    };
+    ref = data.ref;
+    aa_sequence = data.aa_sequence;
+    nuc_sequence = data.nuc_sequence;
+    date = data.date;
+    strain_name = data.strain_name;
+    continent = data.continent;
+    country = data.country;
+    seqdb_hi_names_ = &data.hi_names;
+    seqdb_gisaid_ = &data.gisaid;
 
-    const auto& seqdb = acmacs::seqdb::get();
-    seqdb.find_slaves();
-    std::stack<Node*> parents;
-    const auto pre_populate = [&parents](Node& node) { parents.push(&node); };
-    const auto post_populate = [&parents](Node&) { parents.pop(); };
-    const auto leaf_populate = [&parents, &seqdb, already_in_tree](const Node& node) {
-        if (!node.ref.empty()) {
-            // AD_DEBUG("[populate_with_nuc_duplicates] {}", node.ref.seq_id());
-            for (const auto& slave : node.ref.seq().slaves()) {
-                if (const auto seq_id = slave.seq_id(); !already_in_tree(seq_id)) {
-                    // AD_DEBUG("[populate_with_nuc_duplicates]     {}", seq_id);
-                    parents.top()->to_populate.emplace_back(seq_id, node.edge_length).populate(slave, seqdb);
-                }
+} // acmacs::tal::v3::Node::populate
+
+// ----------------------------------------------------------------------
+
+namespace
+{
+    // open addressing (linear probing) set of seq ids, strings are not copied and must outlive the set
+    class seq_id_set_t
+    {
+      public:
+        seq_id_set_t(size_t expected_size) : slots_(std::bit_ceil(expected_size * 2 + 1)), mask_{slots_.size() - 1} {}
+
+        void insert(std::string_view seq_id)
+        {
+            auto& slot = find_slot(seq_id);
+            if (slot.data() == nullptr)
+                slot = seq_id;
+        }
+
+        bool contains(std::string_view seq_id) const { return find_slot(seq_id).data() != nullptr; }
+
+      private:
+        std::vector<std::string_view> slots_; // data() == nullptr: empty slot
+        const size_t mask_;
+
+        template <typename Self> static auto& find_slot(Self& self, std::string_view seq_id)
+        {
+            for (size_t slot_no = std::hash<std::string_view>{}(seq_id) & self.mask_;; slot_no = (slot_no + 1) & self.mask_) {
+                if (auto& slot = self.slots_[slot_no]; slot.data() == nullptr || slot == seq_id)
+                    return slot;
             }
         }
+
+        std::string_view& find_slot(std::string_view seq_id) { return find_slot(*this, seq_id); }
+        const std::string_view& find_slot(std::string_view seq_id) const { return find_slot(*this, seq_id); }
     };
-    tree::iterate_leaf_pre_post(*this, leaf_populate, pre_populate, post_populate);
+
+} // namespace
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::Tree::populate_with_nuc_duplicates()
+{
+    clades_evaluate(); // for the current leaves only
+    leaf_attributes_.reset();
+    artifacts_.invalidate(artifact_t::structure);
+    artifacts_.invalidate(artifact_t::sequences);
+    const auto& seqdb = acmacs::seqdb::get();
+    seqdb.find_slaves();
+
+    // reserve child storage for duplicates of leaf children, nodes are not moved afterwards and seq_id_set_t can refer to their seq ids
+    const auto number_of_slaves = [](const Node& leaf) { return leaf.is_leaf() && !leaf.ref.empty() ? leaf.ref.seq().slaves().size() : size_t{0}; };
+    tree::iterate_pre(*this, [number_of_slaves](Node& node) {
+        if (const auto slaves = std::accumulate(std::begin(node.subtree), std::end(node.subtree), size_t{0}, [number_of_slaves](size_t sum, const Node& child) { return sum + number_of_slaves(child); }); slaves > 0)
+            node.subtree.reserve(node.subtree.size() + slaves);
+    });
+
+    size_t initial_leaves{0};
+    tree::iterate_leaf(*this, [&initial_leaves](const Node&) { ++initial_leaves; });
+    seq_id_set_t in_tree(initial_leaves);
+    tree::iterate_leaf(*this, [&in_tree](const Node& node) { in_tree.insert(*node.seq_id); });
 
     size_t added_leaves{0};
-    const auto post_add_nuc_duplicate = [&added_leaves](Node& node) {
-        if (!node.to_populate.empty()) {
-            added_leaves += node.to_populate.size();
-            std::move(std::begin(node.to_populate), std::end(node.to_populate), std::back_inserter(node.subtree));
-            node.to_populate.clear();
+    tree::iterate_post(*this, [&seqdb, &in_tree, &added_leaves](Node& node) {
+        for (size_t child_no = 0, initial_children = node.subtree.size(); child_no < initial_children; ++child_no) {
+            if (const auto& child = node.subtree[child_no]; child.is_leaf() && !child.ref.empty()) {
+                for (const auto& slave : child.ref.seq().slaves()) {
+                    if (const auto seq_id = slave.seq_id(); !in_tree.contains(*seq_id)) {
+                        node.subtree.emplace_back(seq_id, child.edge_length).populate(slave, seqdb); // storage reserved, child is not invalidated
+                        ++added_leaves;
+                    }
+                }
+            }
         }
-    };
-    tree::iterate_post(*this, post_add_nuc_duplicate);
+    });
 
-    AD_INFO("populate_with_nuc_duplicates:\n  initial: {:5d}\n  added:   {:5d}\n  total:   {:5d}", all_seq_ids.size(), added_leaves, all_seq_ids.size() + added_leaves);
+    AD_INFO("populate_with_nuc_duplicates:\n  initial: {:5d}\n  added:   {:5d}\n  total:   {:5d}", initial_leaves, added_leaves, initial_leaves + added_leaves);
 
 } // acmacs::tal::v3::Tree::populate_with_nuc_duplicates
 
@@ -702,15 +886,17 @@ void acmacs::tal::v3::Tree::populate_with_nuc_duplicates()
 
 void acmacs::tal::v3::Tree::set_first_last_next_node_id()
 {
-    if (structure_modified_) {
+    if (artifacts_.dirty(artifact_t::node_ids)) {
         // AD_DEBUG("set_first_last_next_node_id");
         // Timeit time_set_first_last_next_node_id(">>>> [time] set_first_last_next_node_id: ");
 
         node_id_t::value_type vertical{0};
         Node* prev_leaf{nullptr};
+        shown_leaves_.clear();
 
-        const auto leaf = [&vertical, &prev_leaf](Node& node) {
+        const auto leaf = [this, &vertical, &prev_leaf](Node& node) {
             if (!node.hidden) {
+                shown_leaves_.push_back(&node);
                 node.node_id.vertical = vertical;
                 node.node_id.horizontal = 0;
                 if (prev_leaf) {
@@ -764,8 +950,7 @@ void acmacs::tal::v3::Tree::set_first_last_next_node_id()
         };
 
         tree::iterate_leaf_pre_post(*this, leaf, pre, post);
-        structure_modified_ = false;
-        // AD_DEBUG("structure_modified_ <- false");
+        artifacts_.computed(artifact_t::node_ids);
     }
 
 } // acmacs::tal::v3::Tree::set_first_last_next_node_id
@@ -1099,6 +1284,8 @@ void acmacs::tal::v3::Tree::clades_reset()
     AD_LOG(acmacs::log::clades, "reset");
     tree::iterate_leaf(*this, [](Node& node) { node.clades.clear(); });
     clades_.clear();
+    pending_clades_.clear();
+    artifacts_.invalidate(artifact_t::clade_sections);
 
 } // acmacs::tal::v3::Tree::clades_reset
 
@@ -1138,6 +1325,7 @@ void acmacs::tal::v3::Tree::add_clade(std::string_view clade_name, std::string_v
 {
     if (auto found = std::find_if(std::begin(clades_), std::end(clades_), [clade_name](const auto& cl) { return cl.name == clade_name; }); found == std::end(clades_))
         clades_.emplace_back(clade_name, display_name);
+    artifacts_.invalidate(artifact_t::clade_sections);
 
 } // acmacs::tal::v3::Tree::add_clade
 
@@ -1157,6 +1345,7 @@ bool acmacs::tal::v3::Tree::has_sequences() const
 // hack to make nuc transitions
 void acmacs::tal::v3::Tree::replace_aa_sequence_with_nuc()
 {
+    clades_evaluate(); // with aa sequences
     acmacs::tal::tree::iterate_leaf(*this, [](acmacs::tal::Node& node) {
         if (node.nuc_sequence.empty())
             AD_WARNING("replace_aa_sequence_with_nuc: no nuc sequence for {}", node.seq_id);
@@ -1168,32 +1357,16 @@ void acmacs::tal::v3::Tree::replace_aa_sequence_with_nuc()
     acmacs::tal::tree::iterate_pre(*this, [](acmacs::tal::Node& node) {
         node.aa_transitions_ = node.nuc_transitions_;
     });
+    artifacts_.invalidate(artifact_t::sequences);
 
 } // acmacs::tal::v3::Tree::replace_aa_sequence_with_nuc
 
 // ----------------------------------------------------------------------
 
-template <typename AA_AT> static inline void clade_set_by(std::string_view clade_name, AA_AT&& aa_at_pos, std::string_view display_name, acmacs::tal::Tree& tree)
-{
-    tree.add_clade(clade_name, display_name);
-    size_t num = 0;
-    acmacs::tal::tree::iterate_leaf(tree, [&aa_at_pos, clade_name, &num](acmacs::tal::Node& node) {
-        const acmacs::seqdb::sequence_aligned_ref_t* sequence{nullptr};
-        if constexpr (std::is_same_v<std::decay_t<AA_AT>, acmacs::seqdb::amino_acid_at_pos1_eq_list_t>)
-            sequence = &node.aa_sequence;
-        else
-            sequence = &node.nuc_sequence;
-        if (acmacs::seqdb::matches(*sequence, std::forward<AA_AT>(aa_at_pos))) {
-            node.clades.add(clade_name);
-            ++num;
-        }
-    });
-    AD_LOG(acmacs::log::clades, "\"{}\": {} leaves", clade_name, num);
-}
-
 void acmacs::tal::v3::Tree::clade_set_by_aa_at_pos(std::string_view clade_name, const acmacs::seqdb::amino_acid_at_pos1_eq_list_t& aa_at_pos, std::string_view display_name)
 {
-    ::clade_set_by(clade_name, aa_at_pos, display_name, *this);
+    add_clade(clade_name, display_name);
+    pending_clades_.push_back(clade_definition_t{.id = leaf_clades_t::id(clade_name), .aa_at_pos = aa_at_pos, .nuc_at_pos = {}});
 
 } // acmacs::tal::v3::Tree::clade_set_by_aa_at_pos
 
@@ -1201,36 +1374,146 @@ void acmacs::tal::v3::Tree::clade_set_by_aa_at_pos(std::string_view clade_name,
 
 void acmacs::tal::v3::Tree::clade_set_by_nuc_at_pos(std::string_view clade_name, const acmacs::seqdb::nucleotide_at_pos1_eq_list_t& nuc_at_pos, std::string_view display_name)
 {
-    ::clade_set_by(clade_name, nuc_at_pos, display_name, *this);
+    add_clade(clade_name, display_name);
+    pending_clades_.push_back(clade_definition_t{.id = leaf_clades_t::id(clade_name), .aa_at_pos = {}, .nuc_at_pos = nuc_at_pos});
 
 } // acmacs::tal::v3::Tree::clade_set_by_nuc_at_pos
 
 // ----------------------------------------------------------------------
 
-void acmacs::tal::v3::Tree::make_clade_sections()
+namespace
 {
-    AD_LOG(acmacs::log::clades, "make_clade_sections");
+    // For each position used by clade definitions: clades failing their condition at the position for each character.
+    // A leaf belongs to the clades not failed at any position.
+    class clade_fail_table_t
+    {
+      public:
+        using word_t = uint64_t;
+        constexpr static const size_t word_bits{64};
 
-    set_first_last_next_node_id();
+        clade_fail_table_t(size_t number_of_clades) : words_{(number_of_clades + word_bits - 1) / word_bits} {}
 
-    bool clade_data_found = false;
-    tree::iterate_leaf(*this, [this, &clade_data_found](Node& node) {
-        if (!node.hidden) {
-            for (const auto& clade_name : node.clades) {
-                if (clade_t* clade = find_or_add_clade(clade_name); clade) {
-                    if (clade->sections.empty() || (node.node_id.vertical - clade->sections.back().last->node_id.vertical) > 1)
-                        clade->sections.emplace_back(&node);
-                    else
-                        clade->sections.back().last = &node;
-                    clade_data_found = true;
+        constexpr size_t words() const { return words_; }
+
+        template <typename AT_POS> void add(size_t clade_no, const AT_POS& at_pos)
+        {
+            for (const auto& pos_aa_eq : at_pos) {
+                auto& masks = masks_for(std::get<acmacs::seqdb::pos1_t>(pos_aa_eq));
+                for (size_t ch = 0; ch < number_of_chars; ++ch) {
+                    if ((static_cast<char>(ch) == std::get<char>(pos_aa_eq)) != std::get<bool>(pos_aa_eq))
+                        masks[ch * words_ + clade_no / word_bits] |= word_t{1} << (clade_no % word_bits);
                 }
             }
         }
+
+        // ORs clades failed by the sequence into failed (words() words)
+        void failed(const acmacs::seqdb::sequence_aligned_ref_t& sequence, word_t* failed) const
+        {
+            for (const auto& [pos1, masks] : positions_) {
+                const auto* mask = &masks[static_cast<unsigned char>(sequence.at(pos1)) * words_];
+                for (size_t word_no = 0; word_no < words_; ++word_no)
+                    failed[word_no] |= mask[word_no];
+            }
+        }
+
+      private:
+        constexpr static const size_t number_of_chars{256};
+
+        size_t words_;
+        std::vector<std::pair<acmacs::seqdb::pos1_t, std::vector<word_t>>> positions_;
+
+        std::vector<word_t>& masks_for(acmacs::seqdb::pos1_t pos1)
+        {
+            if (auto found = std::find_if(std::begin(positions_), std::end(positions_), [pos1](const auto& en) { return en.first == pos1; }); found != std::end(positions_))
+                return found->second;
+            else
+                return positions_.emplace_back(pos1, std::vector<word_t>(number_of_chars * words_, word_t{0})).second;
+        }
+    };
+
+} // namespace
+
+void acmacs::tal::v3::Tree::clades_evaluate()
+{
+    if (pending_clades_.empty())
+        return;
+
+    Timeit time1(">>>> clades_evaluate: ", report_time::no);
+    clade_fail_table_t by_aa{pending_clades_.size()}, by_nuc{pending_clades_.size()};
+    for (size_t clade_no = 0; clade_no < pending_clades_.size(); ++clade_no) {
+        by_aa.add(clade_no, pending_clades_[clade_no].aa_at_pos);
+        by_nuc.add(clade_no, pending_clades_[clade_no].nuc_at_pos);
+    }
+
+    std::vector<Node*> leaves;
+    tree::iterate_leaf(*this, [&leaves](Node& leaf) { leaves.push_back(&leaf); });
+    std::vector<size_t> leaves_in_clade(pending_clades_.size(), 0);
+    std::mutex leaves_in_clade_access;
+    // leaves are evaluated in parallel, each one updates its own clades only
+    parallel_for_chunks(leaves.size(), 1024, [this, &leaves, &by_aa, &by_nuc, &leaves_in_clade, &leaves_in_clade_access](size_t first, size_t last) {
+        std::vector<clade_fail_table_t::word_t> failed(by_aa.words());
+        std::vector<size_t> chunk_leaves_in_clade(pending_clades_.size(), 0);
+        for (size_t leaf_no = first; leaf_no < last; ++leaf_no) {
+            auto& leaf = *leaves[leaf_no];
+            std::fill(std::begin(failed), std::end(failed), clade_fail_table_t::word_t{0});
+            by_aa.failed(leaf.aa_sequence, failed.data());
+            by_nuc.failed(leaf.nuc_sequence, failed.data());
+            for (size_t clade_no = 0; clade_no < pending_clades_.size(); ++clade_no) {
+                if ((failed[clade_no / clade_fail_table_t::word_bits] & (clade_fail_table_t::word_t{1} << (clade_no % clade_fail_table_t::word_bits))) == 0) {
+                    leaf.clades.add(pending_clades_[clade_no].id);
+                    ++chunk_leaves_in_clade[clade_no];
+                }
+            }
+        }
+        std::unique_lock lock{leaves_in_clade_access};
+        std::transform(std::begin(leaves_in_clade), std::end(leaves_in_clade), std::begin(chunk_leaves_in_clade), std::begin(leaves_in_clade), std::plus<size_t>{});
     });
+
+    for (size_t clade_no = 0; clade_no < pending_clades_.size(); ++clade_no)
+        AD_LOG(acmacs::log::clades, "\"{}\": {} leaves", leaf_clades_t::name(pending_clades_[clade_no].id), leaves_in_clade[clade_no]);
+    pending_clades_.clear();
+    artifacts_.invalidate(artifact_t::clade_sections);
+
+} // acmacs::tal::v3::Tree::clades_evaluate
+
+// ----------------------------------------------------------------------
+
+void acmacs::tal::v3::Tree::make_clade_sections()
+{
+    clades_evaluate();
+    set_first_last_next_node_id();
+    if (!artifacts_.dirty(artifact_t::clade_sections))
+        return;
+
+    AD_LOG(acmacs::log::clades, "make_clade_sections");
+    for (auto& clade : clades_) {
+        clade.sections.clear();
+        clade.leaves.reset(shown_leaves_.size());
+    }
+
+    std::vector<size_t> clade_index_by_id; // index in clades_, clades_ may grow in find_or_add_clade()
+    for (size_t vertical = 0; vertical < shown_leaves_.size(); ++vertical) {
+        for (const auto clade_id : shown_leaves_[vertical]->clades) {
+            if (clade_index_by_id.size() <= clade_id)
+                clade_index_by_id.resize(clade_id + 1ul, std::numeric_limits<size_t>::max());
+            if (clade_index_by_id[clade_id] >= clades_.size()) {
+                clade_index_by_id[clade_id] = static_cast<size_t>(find_or_add_clade(leaf_clades_t::name(clade_id)) - clades_.data());
+                clades_[clade_index_by_id[clade_id]].leaves.reset(shown_leaves_.size());
+            }
+            clades_[clade_index_by_id[clade_id]].leaves.insert(vertical);
+        }
+    }
+
+    bool clade_data_found = false;
+    for (auto& clade : clades_) {
+        clade.leaves.for_each_run([this, &clade](size_t first, size_t last) { clade.sections.emplace_back(shown_leaves_[first], shown_leaves_[last]); });
+        clade_data_found |= !clade.sections.empty();
+    }
     if (!clade_data_found) {
         // AD_WARNING("no clade names found in tree nodes, forgot to add \"clades-{{virus-type/lineage}}\" or \"clades-whocc\" in settings?");
         AD_WARNING("no clade names found in tree nodes, forgot to populate tree with ae tree-to-json?");
     }
+    artifacts_.computed(artifact_t::clade_sections);
 
 } // acmacs::tal::v3::Tree::make_clade_sections
 
@@ -1261,92 +1544,131 @@ void acmacs::tal::v3::Tree::clade_report(std::string_view clade_name_to_report)
 
 // ----------------------------------------------------------------------
 
-struct string_hash
+namespace
 {
-    using hash_type = std::hash<std::string_view>;
-    using is_transparent = void;
+    struct string_hash
+    {
+        using hash_type = std::hash<std::string_view>;
+        using is_transparent = void;
 
-    size_t operator()(const char* str) const        { return hash_type{}(str); }
-    size_t operator()(std::string_view str) const   { return hash_type{}(str); }
-    size_t operator()(std::string const& str) const { return hash_type{}(str); }
-};
+        size_t operator()(const char* str) const        { return hash_type{}(str); }
+        size_t operator()(std::string_view str) const   { return hash_type{}(str); }
+        size_t operator()(std::string const& str) const { return hash_type{}(str); }
+    };
 
-void acmacs::tal::v3::Tree::match(const acmacs::chart::Chart& chart) const
-{
-    if (!chart_matched_) {
-        auto antigens = chart.antigens();
-        auto sera = chart.sera();
-        std::unordered_map<std::string, size_t, string_hash, std::equal_to<>> antigen_names, antigen_names_full;
-        std::unordered_map<std::string, std::vector<size_t>, string_hash, std::equal_to<>> serum_names;
+    // "/2019_" -> the name part ends before "_"
+    // replaces std::regex "/(?:19|20)[0-9][0-9](_)"
+    inline std::string_view name_without_passage(std::string_view seq_id)
+    {
+        const auto is_digit = [](char cc) { return cc >= '0' && cc <= '9'; };
+        for (auto slash = seq_id.find('/'); slash != std::string_view::npos && (slash + 6) <= seq_id.size(); slash = seq_id.find('/', slash + 1)) {
+            const auto* year = seq_id.data() + slash + 1;
+            if (((year[0] == '1' && year[1] == '9') || (year[0] == '2' && year[1] == '0')) && is_digit(year[2]) && is_digit(year[3]) && year[4] == '_')
+                return seq_id.substr(0, slash + 5);
+        }
+        return seq_id;
+    }
 
-        const auto match_seqdb3_names = [&antigens, &antigen_names_full, &serum_names, &sera, this](const Node& node) {
-            if (antigen_names_full.empty()) {
-                for (size_t ag_no = 0; ag_no < antigens->size(); ++ag_no)
-                    antigen_names_full[antigens->at(ag_no)->name_full()] = ag_no;
-            }
-            if (serum_names.empty()) {
-                for (size_t sr_no = 0; sr_no < sera->size(); ++sr_no)
-                    serum_names[*sera->at(sr_no)->name()].push_back(sr_no);
+    // Antigen and serum names of the chart in the form used in seq ids (name without subtype, spaces replaced with _)
+    // and, for old seqdb3 seq ids, full antigen names and serum names. Lookups are thread safe.
+    class chart_match_index_t
+    {
+      public:
+        chart_match_index_t(const acmacs::chart::Chart& chart) : antigens_{chart.antigens()}, sera_{chart.sera()}
+        {
+            using namespace std::string_view_literals;
+            const auto make_name = [](const auto& ag_sr) {
+                std::string name = ag_sr.format("{name_without_subtype}"sv);
+                ::string::replace_in_place(name, ' ', '_');
+                return name;
+            };
+            for (size_t ag_no = 0; ag_no < antigens_->size(); ++ag_no)
+                antigen_names_.insert_or_assign(names_.emplace_back(make_name(*antigens_->at(ag_no))), ag_no); // the last antigen with the name wins
+            for (size_t sr_no = 0; sr_no < sera_->size(); ++sr_no)
+                serum_names_[names_.emplace_back(make_name(*sera_->at(sr_no)))].push_back(sr_no);
+        }
+
+        void match(const acmacs::tal::v3::Node& node) const
+        {
+            std::string_view seq_name{node.seq_id};
+            if ((seq_name[0] == 'A' || seq_name[0] == 'B') && (seq_name[1] == '/' || seq_name[1] == '('))
+                match_seqdb3(node);
+            seq_name = name_without_passage(seq_name);
+            if (const auto found = antigen_names_.find(seq_name); found != antigen_names_.end())
+                node.antigen_index_in_chart_ = found->second;
+            if (const auto found = serum_names_.find(seq_name); found != std::end(serum_names_)) {
+                for (auto serum_index : found->second)
+                    node.serum_index_in_chart_.push_back({serum_index});
             }
-            for (const auto& hi_name : node.hi_names) {
-                if (const auto found = antigen_names_full.find(hi_name); found != std::end(antigen_names_full)) {
+        }
+
+        size_t number_of_sera() const { return sera_->size(); }
+
+      private:
+        acmacs::chart::AntigensP antigens_;
+        acmacs::chart::SeraP sera_;
+        std::deque<std::string> names_; // storage for keys below
+        std::unordered_map<std::string_view, size_t> antigen_names_;
+        std::unordered_map<std::string_view, std::vector<size_t>> serum_names_;
+        mutable std::once_flag seqdb3_names_built_; // seqdb3 names are rare, maps are built on demand
+        mutable std::unordered_map<std::string, size_t, string_hash, std::equal_to<>> antigen_names_full_;
+        mutable std::unordered_map<std::string, std::vector<size_t>, string_hash, std::equal_to<>> serum_names_seqdb3_;
+
+        void match_seqdb3(const acmacs::tal::v3::Node& node) const
+        {
+            std::call_once(seqdb3_names_built_, [this]() {
+                for (size_t ag_no = 0; ag_no < antigens_->size(); ++ag_no)
+                    antigen_names_full_[antigens_->at(ag_no)->name_full()] = ag_no;
+                for (size_t sr_no = 0; sr_no < sera_->size(); ++sr_no)
+                    serum_names_seqdb3_[*sera_->at(sr_no)->name()].push_back(sr_no);
+            });
+            for (const auto& hi_name : node.hi_names()) {
+                if (const auto found = antigen_names_full_.find(hi_name); found != std::end(antigen_names_full_)) {
                     node.antigen_index_in_chart_ = found->second;
                     break;
                 }
             }
             const auto parsed_seq_id = acmacs::virus::name::parse(node.seq_id);
-            // AD_DEBUG("parsed_seq_id \"{}\" <- \"{}\"", parsed_seq_id.name(), node.seq_id);
-            if (const auto found = serum_names.find(*parsed_seq_id.name()); found != std::end(serum_names)) {
+            if (const auto found = serum_names_seqdb3_.find(*parsed_seq_id.name()); found != std::end(serum_names_seqdb3_)) {
                 for (auto serum_index : found->second) {
-                    node.serum_index_in_chart_.push_back({serum_index, sera->at(serum_index)->reassortant() == parsed_seq_id.reassortant,
-                                                          sera->at(serum_index)->passage().is_egg() == parsed_seq_id.passage.is_egg(), sera->at(serum_index)->passage() == parsed_seq_id.passage});
-                    serum_to_node_[serum_index].nodes.push_back(&node);
+                    node.serum_index_in_chart_.push_back({serum_index, sera_->at(serum_index)->reassortant() == parsed_seq_id.reassortant,
+                                                          sera_->at(serum_index)->passage().is_egg() == parsed_seq_id.passage.is_egg(), sera_->at(serum_index)->passage() == parsed_seq_id.passage});
                 }
             }
-        };
+        }
+    };
 
-        const std::regex year_passage_sep{"/(?:19|20)[0-9][0-9](_)", acmacs::regex::icase};
-        const auto match_seqdb4_names = [&antigens, &antigen_names, &serum_names, &sera, &year_passage_sep, this](const Node& node) {
-            using namespace std::string_view_literals;
-            const auto make_name = [](const auto& ag_sr) {
-                    std::string name = ag_sr.format("{name_without_subtype}"sv);
-                    ::string::replace_in_place(name, ' ', '_');
-                    return name;
-            };
-            if (antigen_names.empty()) {
-                for (size_t ag_no = 0; ag_no < antigens->size(); ++ag_no)
-                    antigen_names[make_name(*antigens->at(ag_no))] = ag_no;
-            }
-            if (serum_names.empty()) {
-                for (size_t sr_no = 0; sr_no < sera->size(); ++sr_no)
-                    serum_names[make_name(*sera->at(sr_no))].push_back(sr_no);
-            }
-            std::string_view seq_name{node.seq_id};
-            std::cmatch match;
-            if (acmacs::regex::search(node.seq_id, match, year_passage_sep))
-                seq_name.remove_suffix(seq_name.size() - static_cast<size_t>(match.position(1)));
-            // AD_DEBUG("parsed_seq_id \"{}\" <- \"{}\"", seq_name, node.seq_id);
-            if (const auto found = antigen_names.find(seq_name); found != antigen_names.end())
-                node.antigen_index_in_chart_ = found->second;
-            // else
-            //     AD_DEBUG("name not in chart: \"{}\"", seq_name);
-            if (const auto found = serum_names.find(seq_name); found != std::end(serum_names)) {
-                for (auto serum_index : found->second) {
-                    node.serum_index_in_chart_.push_back({serum_index});
-                    serum_to_node_[serum_index].nodes.push_back(&node);
-                }
-            }
-        };
+} // namespace
+
+// ----------------------------------------------------------------------
 
-        serum_to_node_.resize(sera->size());
-        tree::iterate_leaf(*this, [match_seqdb3_names, match_seqdb4_names](const Node& node) {
-            if ((node.seq_id[0] == 'A' || node.seq_id[0] == 'B') && (node.seq_id[1] == '/' || node.seq_id[1] == '(')) {
-                AD_WARNING("trying match_seqdb3_names \"{}\"", node.seq_id);
-                match_seqdb3_names(node);
+void acmacs::tal::v3::Tree::match(const acmacs::chart::Chart& chart) const
+{
+    if (artifacts_.dirty(artifact_t::chart_match)) {
+        const chart_match_index_t index{chart};
+
+        std::vector<const Node*> leaves;
+        tree::iterate_leaf(*this, [&leaves](const Node& node) { leaves.push_back(&node); });
+        // leaves are matched in parallel, each one updates its own fields only
+        parallel_for_chunks(leaves.size(), 1024, [&leaves, &index](size_t first, size_t last) {
+            for (size_t no = first; no < last; ++no) {
+                // the chart may have been replaced since the previous match
+                leaves[no]->antigen_index_in_chart_.reset();
+                leaves[no]->serum_index_in_chart_.clear();
+                index.match(*leaves[no]);
             }
-            match_seqdb4_names(node); // match seqdb4 anyway
         });
-        for (const auto sr_no : range_from_0_to(sera->size())) {
+
+        serum_to_node_.clear();
+        serum_to_node_.resize(index.number_of_sera());
+        for (const auto* leaf : leaves) {
+            if ((leaf->seq_id[0] == 'A' || leaf->seq_id[0] == 'B') && (leaf->seq_id[1] == '/' || leaf->seq_id[1] == '('))
+                AD_WARNING("trying match_seqdb3_names \"{}\"", leaf->seq_id);
+            for (const auto& serum : leaf->serum_index_in_chart_)
+                serum_to_node_[serum.serum_no].nodes.push_back(leaf);
+        }
+
+        for (const auto sr_no : range_from_0_to(index.number_of_sera())) {
             if (auto& nodes = serum_to_node_[sr_no].nodes; !nodes.empty()) {
                 // sort node pointers to have one with the best serum match first (the one matching reassortant and passage type)
                 ranges::sort(nodes, [sr_no](const auto& n1, const auto& n2) {
@@ -1359,7 +1681,7 @@ void acmacs::tal::v3::Tree::match(const acmacs::chart::Chart& chart) const
                 AD_DEBUG("serum nodes {:3d} {:2d} {} {}", sr_no, serum_to_node_[sr_no].nodes.size(), nodes.front()->seq_id, nodes.front()->node_id);
             }
         }
-        chart_matched_ = true;
+        artifacts_.computed(artifact_t::chart_match);
     }
 
 } // acmacs::tal::v3::Tree::match
@@ -1370,8 +1692,10 @@ void acmacs::tal::v3::Tree::set_top_gap(const Node& node, double gap) const
 {
     // gap is a fraction of tree height (number of shown leaves)
     const auto gap_to_use{gap * static_cast<double>(number_leaves_in_subtree())};
-    if (node.vertical_offset_ < gap_to_use)
+    if (node.vertical_offset_ < gap_to_use) {
         node.vertical_offset_ = gap_to_use;
+        artifacts_.invalidate(artifact_t::vertical_offsets);
+    }
 
 } // acmacs::tal::v3::Tree::set_top_gap
 
@@ -1400,6 +1724,7 @@ double acmacs::tal::v3::Tree::compute_cumulative_vertical_offsets()
                                 if (const auto& shown_children = node.shown_children(); !shown_children.empty())
                                     node.cumulative_vertical_offset_ = (shown_children.front()->cumulative_vertical_offset_ + shown_children.back()->cumulative_vertical_offset_) / 2.0;
                             });
+    artifacts_.computed(artifact_t::vertical_offsets);
     return height;
 
 } // acmacs::tal::v3::Tree::compute_cumulative_vertical_offsets
@@ -2,9 +2,18 @@
 
 #include <string>
 #include <vector>
+#include <span>
 #include <tuple>
 #include <optional>
+#include <memory>
 #include <algorithm>
+#include <compare>
+#include <iterator>
+#include <numeric>
+#include <bit>
+#include <unordered_set>
+#include <limits>
+#include <cstdint>
 
 #include "acmacs-base/log.hh"
 #include "acmacs-base/named-type.hh"
@@ -15,6 +24,7 @@
 #include "acmacs-base/string-from-chars.hh"
 #include "seqdb-3/seqdb.hh"
 #include "acmacs-tal/aa-transition.hh"
+#include "acmacs-tal/artifacts.hh"
 #include "acmacs-tal/error.hh"
 
 // ----------------------------------------------------------------------
@@ -27,14 +37,53 @@ namespace acmacs::chart
 namespace acmacs::tal::inline v3
 {
     class Node;
+    struct seqdb_leaf_data_t; // seqdb-population.hh
+    class LeafAttributes;     // leaf-attributes.hh
 
     using seq_id_t = acmacs::seqdb::seq_id_t; // string, not string_view to support populate_with_nuc_duplicates
 
-    using EdgeLength = named_double_from_string_t<struct acmacs_tal_EdgeLength_tag>;
-    // class EdgeLength : public named_double_from_string_t<struct acmacs_tal_EdgeLength_tag>
-    // {
-    //   public:
-    // };
+    // Edge length read from a tree file refers to its text in the source (Tree::data_buffer()) and is exported unchanged,
+    // computed edge lengths (re_root, cumulative) have no source text and are exported using the shortest round-trip representation.
+    // No allocation is made in either case.
+    class EdgeLength
+    {
+      public:
+        constexpr EdgeLength() = default;
+        constexpr explicit EdgeLength(double value) : value_{value} {}
+        // source must outlive edge length, i.e. it is a view into Tree::data_buffer()
+        explicit EdgeLength(std::string_view source) : value_{acmacs::string::from_chars<double>(source)}, source_{source} {}
+
+        constexpr double as_number() const { return value_; }
+        constexpr bool is_zero() const { return value_ == 0.0; }
+        constexpr std::string_view source() const { return source_; }
+
+        template <typename Out> Out format_to(Out out) const
+        {
+            if (!source_.empty())
+                return std::copy(std::begin(source_), std::end(source_), out);
+            else
+                return fmt::format_to(out, "{}", value_); // shortest round-trip representation
+        }
+
+        std::string as_string() const
+        {
+            std::string result;
+            format_to(std::back_inserter(result));
+            return result;
+        }
+
+        constexpr bool operator==(const EdgeLength& rhs) const { return value_ == rhs.value_; }
+        constexpr std::partial_ordering operator<=>(const EdgeLength& rhs) const { return value_ <=> rhs.value_; }
+
+        constexpr EdgeLength operator+(const EdgeLength& rhs) const { return EdgeLength{value_ + rhs.value_}; }
+        constexpr EdgeLength operator-(const EdgeLength& rhs) const { return EdgeLength{value_ - rhs.value_}; }
+        constexpr EdgeLength& operator+=(const EdgeLength& rhs) { return *this = *this + rhs; }
+        constexpr EdgeLength& operator-=(const EdgeLength& rhs) { return *this = *this - rhs; }
+
+      private:
+        double value_{0.0};
+        std::string_view source_{};
+    };
 
     using NodePath = acmacs::named_vector_t<const Node*, struct acmacs_tal_NodePath_tag>;
 
@@ -58,6 +107,36 @@ namespace acmacs::tal::inline v3
         constexpr bool operator<(const node_id_t& rhs) const { return vertical < rhs.vertical; }
     };
 
+    // Clades of a leaf kept as sorted ids of the clade names. Names are interned process wide: there are few of them and they
+    // are shared by many leaves and by copies of the tree (batch and interactive modes).
+    class leaf_clades_t
+    {
+      public:
+        using id_t = uint16_t;
+        constexpr static const id_t not_found{std::numeric_limits<id_t>::max()};
+
+        static id_t id(std::string_view name);   // adds name if not yet present
+        static id_t find(std::string_view name); // not_found if name was never added
+        static std::string_view name(id_t id);
+
+        void add(std::string_view name) { add(id(name)); }
+        void add(id_t id)
+        {
+            if (const auto found = std::lower_bound(std::begin(ids_), std::end(ids_), id); found == std::end(ids_) || *found != id)
+                ids_.insert(found, id);
+        }
+        bool exists(id_t id) const { return std::binary_search(std::begin(ids_), std::end(ids_), id); }
+        bool exists(std::string_view name) const { return exists(find(name)); }
+        void clear() { ids_.clear(); }
+        bool empty() const { return ids_.empty(); }
+        size_t size() const { return ids_.size(); }
+        auto begin() const { return ids_.begin(); }
+        auto end() const { return ids_.end(); }
+
+      private:
+        std::vector<id_t> ids_;
+    };
+
     namespace draw_tree
     {
         struct AATransitionsParameters; // draw-tree.hh
@@ -80,6 +159,9 @@ namespace acmacs::tal::inline v3
 
         const Node& find_first_leaf() const;
 
+        std::span<const std::string_view> hi_names() const { return seqdb_hi_names_ ? std::span<const std::string_view>{*seqdb_hi_names_} : std::span<const std::string_view>{imported_hi_names}; }
+        const seqdb::SeqdbSeq::gisaid_data_t& gisaid() const { return seqdb_gisaid_ ? *seqdb_gisaid_ : no_gisaid_; }
+
         // all nodes
         EdgeLength edge_length{0.0};
         mutable EdgeLength cumulative_edge_length{EdgeLengthNotSet};
@@ -94,8 +176,8 @@ namespace acmacs::tal::inline v3
         std::string_view date;
         std::string_view continent;
         std::string_view country;
-        std::vector<std::string_view> hi_names;
-        acmacs::flat_set_t<std::string> clades;
+        std::vector<std::string_view> imported_hi_names; // from json import, hi_names() returns ones from seqdb if populated
+        leaf_clades_t clades;
 
         // branch node only
         Subtree subtree;
@@ -115,13 +197,18 @@ namespace acmacs::tal::inline v3
         enum class leaf_position { first, middle, last, single };
         leaf_position leaf_pos{leaf_position::middle};
         node_id_t node_id; // includes vertical leaf number for leaves
-        seqdb::SeqdbSeq::gisaid_data_t gisaid;   // from seqdb
+        // from seqdb, set by populate(), refer to the seqdb data (SeqdbPopulation entry) instead of copying them for every leaf
+        const std::vector<std::string_view>* seqdb_hi_names_{nullptr};
+        const seqdb::SeqdbSeq::gisaid_data_t* seqdb_gisaid_{nullptr};
+        inline static const seqdb::SeqdbSeq::gisaid_data_t no_gisaid_{};
 
         // all nodes
         ladderize_helper_t ladderize_helper_;
+        mutable size_t set_index_{0}; // assigned by NodeIndex
 
         // leaf node only
         mutable std::optional<size_t> antigen_index_in_chart_;
+        mutable size_t leaf_attributes_row_{0}; // assigned by LeafAttributes
 
         struct serum_from_chart_t
         {
@@ -133,8 +220,6 @@ namespace acmacs::tal::inline v3
 
         mutable std::vector<serum_from_chart_t> serum_index_in_chart_;
 
-        Subtree to_populate; // populate_with_nuc_duplicates()
-
         // -------------------- AA transitions (branch node only) --------------------
         AA_Transitions aa_transitions_;
         AA_Transitions nuc_transitions_; // "import" method only!
@@ -163,6 +248,7 @@ namespace acmacs::tal::inline v3
 
         void hide();
         void populate(const acmacs::seqdb::ref& a_ref, const acmacs::seqdb::Seqdb& seqdb);
+        void populate(const seqdb_leaf_data_t& data); // resolved by SeqdbPopulation
 
         size_t number_leaves_in_subtree() const { return number_leaves; }
 
@@ -191,7 +277,8 @@ namespace acmacs::tal::inline v3
         void add(const NodeSetT<N>& another) { std::copy(std::begin(another), std::end(another), std::back_inserter(*this)); }
         void filter(const NodeSetT<N>& another)
         {
-            this->erase(std::remove_if(this->begin(), this->end(), [&another](const auto& en) { return std::find(std::begin(another), std::end(another), en) == std::end(another); }), this->end());
+            const std::unordered_set<N> keep(std::begin(another), std::end(another));
+            this->erase(std::remove_if(this->begin(), this->end(), [&keep](const auto& en) { return !keep.contains(en); }), this->end());
         }
     };
 
@@ -200,13 +287,174 @@ namespace acmacs::tal::inline v3
 
     // ----------------------------------------------------------------------
 
+    // Numbers nodes of the subtree in pre-order (node.set_index_) for NodeBitset.
+    // Numbering is valid until the tree structure is changed (hide, ladderize, re_root, populate_with_nuc_duplicates),
+    // keep NodeIndex for the duration of a single selection.
+    class NodeIndex
+    {
+      public:
+        NodeIndex(Node& root);
+
+        size_t size() const { return nodes_.size(); }
+        Node* node(size_t index) const { return nodes_[index]; }
+
+      private:
+        std::vector<Node*> nodes_;
+    };
+
+    // Set of nodes numbered by NodeIndex: O(1) insert and membership test, union, intersection and difference work on 64 nodes at once.
+    class NodeBitset
+    {
+      public:
+        NodeBitset(const NodeIndex& index) : index_{&index}, words_((index.size() + word_bits - 1) / word_bits, word_t{0}) {}
+        NodeBitset(const NodeIndex& index, const NodeSet& nodes) : NodeBitset(index) { insert(nodes); }
+
+        void insert(const Node& node) { words_[node.set_index_ / word_bits] |= bit(node); }
+        void insert(const NodeSet& nodes) { for (const auto* node : nodes) insert(*node); }
+        void erase(const Node& node) { words_[node.set_index_ / word_bits] &= ~bit(node); }
+        bool contains(const Node& node) const { return (words_[node.set_index_ / word_bits] & bit(node)) != 0; }
+
+        size_t size() const { return std::accumulate(std::begin(words_), std::end(words_), size_t{0}, [](size_t sum, word_t word) { return sum + static_cast<size_t>(std::popcount(word)); }); }
+        bool empty() const { return std::all_of(std::begin(words_), std::end(words_), [](word_t word) { return word == 0; }); }
+
+        NodeBitset& operator|=(const NodeBitset& rhs) { return combine(rhs, [](word_t& word, word_t other) { word |= other; }); }
+        NodeBitset& operator&=(const NodeBitset& rhs) { return combine(rhs, [](word_t& word, word_t other) { word &= other; }); }
+        NodeBitset& operator-=(const NodeBitset& rhs) { return combine(rhs, [](word_t& word, word_t other) { word &= ~other; }); }
+
+        // calls func(Node&) for the nodes of the set in pre-order
+        template <typename F> void for_each(F&& func) const
+        {
+            for (size_t word_no = 0; word_no < words_.size(); ++word_no) {
+                for (auto word = words_[word_no]; word != 0; word &= word - 1)
+                    func(*index_->node(word_no * word_bits + static_cast<size_t>(std::countr_zero(word))));
+            }
+        }
+
+        NodeSet nodes() const
+        {
+            NodeSet result;
+            result.reserve(size());
+            for_each([&result](Node& node) { result.push_back(&node); });
+            return result;
+        }
+
+      private:
+        using word_t = uint64_t;
+        constexpr static const size_t word_bits{64};
+
+        const NodeIndex* index_;
+        std::vector<word_t> words_;
+
+        static word_t bit(const Node& node) { return word_t{1} << (node.set_index_ % word_bits); }
+
+        template <typename F> NodeBitset& combine(const NodeBitset& rhs, F&& func)
+        {
+            for (size_t word_no = 0; word_no < words_.size(); ++word_no)
+                func(words_[word_no], rhs.words_[word_no]);
+            return *this;
+        }
+    };
+
+    // ----------------------------------------------------------------------
+
+    // Set of shown leaves numbered by node_id.vertical (Tree::shown_leaves()), runs of consecutive leaves are found 64 leaves at once.
+    class LeafBitset
+    {
+      public:
+        LeafBitset() = default;
+        LeafBitset(size_t number_of_leaves) { reset(number_of_leaves); }
+
+        void reset(size_t number_of_leaves) { words_.assign((number_of_leaves + word_bits - 1) / word_bits, word_t{0}); }
+        void insert(size_t vertical) { words_[vertical / word_bits] |= word_t{1} << (vertical % word_bits); }
+        bool contains(size_t vertical) const { return (words_[vertical / word_bits] & (word_t{1} << (vertical % word_bits))) != 0; }
+
+        size_t size() const { return std::accumulate(std::begin(words_), std::end(words_), size_t{0}, [](size_t sum, word_t word) { return sum + static_cast<size_t>(std::popcount(word)); }); }
+        bool empty() const { return std::all_of(std::begin(words_), std::end(words_), [](word_t word) { return word == 0; }); }
+
+        // calls func(vertical) for the leaves of the set in vertical order
+        template <typename F> void for_each(F&& func) const
+        {
+            for (size_t word_no = 0; word_no < words_.size(); ++word_no) {
+                for (auto word = words_[word_no]; word != 0; word &= word - 1)
+                    func(word_no * word_bits + static_cast<size_t>(std::countr_zero(word)));
+            }
+        }
+
+        // calls func(first, last) for each run of consecutive leaves of the set, last is included
+        template <typename F> void for_each_run(F&& func) const
+        {
+            for (auto first = find(0, true); first < number_of_bits(); ) {
+                const auto after_last = find(first, false);
+                func(first, after_last - 1);
+                first = find(after_last, true);
+            }
+        }
+
+      private:
+        using word_t = uint64_t;
+        constexpr static const size_t word_bits{64};
+
+        std::vector<word_t> words_; // bits after the last leaf are never set
+
+        size_t number_of_bits() const { return words_.size() * word_bits; }
+
+        // first set (or not set) bit at or after from, number_of_bits() if there is none
+        size_t find(size_t from, bool set) const
+        {
+            for (auto word_no = from / word_bits; word_no < words_.size(); ++word_no) {
+                auto word = set ? words_[word_no] : ~words_[word_no];
+                if (word_no == from / word_bits)
+                    word &= ~word_t{0} << (from % word_bits);
+                if (word != 0)
+                    return word_no * word_bits + static_cast<size_t>(std::countr_zero(word));
+            }
+            return number_of_bits();
+        }
+    };
+
+    // ----------------------------------------------------------------------
+
+    // Tree member holding Node pointers into the tree, a copy of the tree gets it empty (it is re-made, see TreeArtifacts)
+    template <typename T> class reset_on_copy : public T
+    {
+      public:
+        reset_on_copy() = default;
+        reset_on_copy(const reset_on_copy&) : T{} {}
+        reset_on_copy(reset_on_copy&&) noexcept = default;
+        reset_on_copy& operator=(const reset_on_copy&) { T::operator=(T{}); return *this; }
+        reset_on_copy& operator=(reset_on_copy&&) noexcept = default;
+    };
+
+    // Artifacts keeping Node pointers (node ids: prev/next leaves, shown leaves, clade sections; aa transitions: node for left;
+    // chart match: nodes of sera) are dirty in a copy of the tree
+    class TreeArtifacts : public Artifacts
+    {
+      public:
+        TreeArtifacts() = default;
+        TreeArtifacts(const TreeArtifacts& source) : Artifacts{source} { invalidate_node_pointers(); }
+        TreeArtifacts(TreeArtifacts&&) = default;
+        TreeArtifacts& operator=(const TreeArtifacts& source) { Artifacts::operator=(source); invalidate_node_pointers(); return *this; }
+        TreeArtifacts& operator=(TreeArtifacts&&) = default;
+
+      private:
+        void invalidate_node_pointers()
+        {
+            invalidate(artifact_t::node_ids);
+            invalidate(artifact_t::aa_transitions);
+            invalidate(artifact_t::chart_match);
+        }
+    };
+
+    // ----------------------------------------------------------------------
+
     class Tree : public Node
     {
       public:
         void erase();
 
-        void data_buffer(std::string&& data) { data_buffer_ = std::move(data); }
-        std::string_view data_buffer() const { return data_buffer_; }
+        // data buffer (text of the imported file, nodes refer to it) is shared with copies of the tree
+        void data_buffer(std::string&& data) { data_buffer_ = std::make_shared<const std::string>(std::move(data)); }
+        std::string_view data_buffer() const { return data_buffer_ ? std::string_view{*data_buffer_} : std::string_view{}; }
 
         std::string_view virus_type() const { return virus_type_; }
         std::string_view lineage() const { return lineage_; }
@@ -222,6 +470,12 @@ namespace acmacs::tal::inline v3
         void match_seqdb(std::string_view seqdb_filename);
         void populate_with_nuc_duplicates();
 
+        // columns of leaf date, country, continent, location, passage, made on the first use after match_seqdb/populate_with_nuc_duplicates/import
+        std::shared_ptr<const LeafAttributes> leaf_attributes() const;
+
+        // dirty flags of the data computed from the tree, see artifacts.hh
+        Artifacts& artifacts() const { return artifacts_; }
+
         std::string report_cumulative(size_t max) const;
         std::string report_by_edge(size_t max, size_t max_names_per_row) const;
         void cumulative_calculate(bool recalculate = false) const;
@@ -254,6 +508,11 @@ namespace acmacs::tal::inline v3
 
         void select_matches_chart_antigens(NodeSet& nodes, Select update);
         void select_matches_chart_sera(NodeSet& nodes, Select update, serum_match_t match_type);
+        static bool matches_chart_serum(const Node& node, serum_match_t match_type);
+
+        // helpers for select_if_edge_more_than_mean_edge_of and select_by_top_cumulative_gap, used by NodeQuery too
+        double mean_edge_of(double fraction_or_number) const { return mean_edge_of(fraction_or_number, sorted_by_edge()); }
+        std::optional<double> top_cumulative_gap_cut_off(double top_gap_rel) const; // nullopt: gap criterium not applicable
 
         acmacs::chart::PointIndexList chart_antigens_in_tree() const;
         acmacs::chart::PointIndexList chart_antigens_in_section(const Node* first, const Node* last) const;
@@ -288,6 +547,7 @@ namespace acmacs::tal::inline v3
         struct clade_section_t
         {
             clade_section_t(const Node* node) : first{node}, last{node} {}
+            clade_section_t(const Node* a_first, const Node* a_last) : first{a_first}, last{a_last} {}
             const Node* first;
             const Node* last;
         };
@@ -297,7 +557,8 @@ namespace acmacs::tal::inline v3
             clade_t(std::string_view nam, std::string_view disp) : name{nam}, display_name{disp.empty() ? nam : disp} {}
             std::string name;
             std::string display_name;
-            std::vector<clade_section_t> sections;
+            reset_on_copy<std::vector<clade_section_t>> sections;
+            LeafBitset leaves; // shown leaves of the clade, sections are runs of consecutive ones
         };
 
         using clades_t = std::vector<clade_t>;
@@ -313,8 +574,11 @@ namespace acmacs::tal::inline v3
         constexpr const clades_t& clades() const { return clades_; }
 
         void clades_reset();
+        // clade definitions are collected and evaluated together by clades_evaluate() in a single pass over the leaf sequences
         void clade_set_by_aa_at_pos(std::string_view name, const acmacs::seqdb::amino_acid_at_pos1_eq_list_t& aa_at_pos, std::string_view display_name);
         void clade_set_by_nuc_at_pos(std::string_view name, const acmacs::seqdb::nucleotide_at_pos1_eq_list_t& nuc_at_pos, std::string_view display_name);
+        // adds clades of collected definitions to leaves, called before leaf clades are used and before leaves or sequences are changed
+        void clades_evaluate();
         void clade_report(std::string_view name = {}) const;
 
         // ----------------------------------------------------------------------
@@ -332,6 +596,7 @@ namespace acmacs::tal::inline v3
         void make_clade_sections();
 
         void set_first_last_next_node_id();
+        const std::vector<Node*>& shown_leaves() const { return shown_leaves_; } // by node_id.vertical, set in set_first_last_next_node_id()
 
         enum class leaves_only { no, yes };
         std::vector<const Node*> sorted_by_cumulative_edge(leaves_only lo) const; // bigger cumul length first
@@ -355,15 +620,25 @@ namespace acmacs::tal::inline v3
                             const std::vector<const Node*>& sorted) const; // nodes sorted by edge, longest nodes (fraction of all or by number) taken and their mean edge calculated
         double mean_cumulative_edge_of(double fraction_or_number, const std::vector<const Node*>& sorted) const;
 
-        void structure_modified([[maybe_unused]] std::string_view on_action) { structure_modified_ = true; } // AD_DEBUG("structure_modified: {}", on_action);
+        void structure_modified([[maybe_unused]] std::string_view on_action) { artifacts_.invalidate(artifact_t::structure); } // AD_DEBUG("structure_modified: {}", on_action);
 
-        std::string data_buffer_;
+        std::shared_ptr<const std::string> data_buffer_;
         std::string virus_type_;
         std::string lineage_;
         clades_t clades_;
-        mutable bool chart_matched_{false};
-        mutable serum_to_node_t serum_to_node_; // nodes matched for each serum index from the chart
-        bool structure_modified_{true};
+        reset_on_copy<std::vector<Node*>> shown_leaves_;
+
+        struct clade_definition_t
+        {
+            leaf_clades_t::id_t id;
+            acmacs::seqdb::amino_acid_at_pos1_eq_list_t aa_at_pos;
+            acmacs::seqdb::nucleotide_at_pos1_eq_list_t nuc_at_pos;
+        };
+
+        std::vector<clade_definition_t> pending_clades_;
+        mutable std::shared_ptr<const LeafAttributes> leaf_attributes_; // shared with copies of the tree until leaves are changed
+        mutable reset_on_copy<serum_to_node_t> serum_to_node_; // nodes matched for each serum index from the chart
+        mutable TreeArtifacts artifacts_;
 
     }; // class Tree
 
@@ -373,6 +648,31 @@ namespace acmacs::tal::inline v3
 
 // ======================================================================
 
+// {} -> source text or shortest round-trip representation
+// {:.6f} -> formatted as double
+template <> struct fmt::formatter<acmacs::tal::EdgeLength> : fmt::formatter<double>
+{
+    template <typename ParseContext> constexpr auto parse(ParseContext& ctx) -> decltype(ctx.begin())
+    {
+        if (auto it = ctx.begin(); it == ctx.end() || *it == '}') {
+            as_is_ = true;
+            return it;
+        }
+        return fmt::formatter<double>::parse(ctx);
+    }
+
+    template <typename FormatCtx> auto format(const acmacs::tal::EdgeLength& edge, FormatCtx& ctx) const
+    {
+        if (as_is_)
+            return edge.format_to(ctx.out());
+        return fmt::formatter<double>::format(edge.as_number(), ctx);
+    }
+
+    bool as_is_{false};
+};
+
+// ----------------------------------------------------------------------
+
 // {:4.3} -> {:>4d}.{:<3d}
 // {:.0} -> {:d}
 template <> struct fmt::formatter<acmacs::tal::node_id_t>